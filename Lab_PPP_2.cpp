@@ -3,9 +3,35 @@
 #include <limits>
 #include <locale>
 #include <string>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <charconv>
+#include <cmath>
+#include <ctime>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <array>
+#include <string_view>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <iterator>
+
+#include "Lab_PPP_common.h"
 
 using namespace std;
 
+enum class TariffSort {
+    ByName,
+    ByPrice
+};
+
 enum class CallType {
     Regular,
     Discounted
@@ -16,188 +42,3688 @@ CallType stringToCallType(const string& str) {
     return CallType::Discounted;
 }
 
+// Точность вывода денежных сумм в отчётах
+constexpr int moneyPrecision = 2;
+
 struct Tariff {
     string cityName;
     double price;
+    Currency currency;
 
-    Tariff(const string& name, double p) : cityName(name), price(p) {}
+    Tariff(const string& name, double p, Currency c) : cityName(name), price(p), currency(c) {}
 };
 
 struct Call {
+    unsigned long long id;
     string clientName;
     string cityName;
     double duration;
+    double pricePerMinute;
     double price;
-    Call(const string& client, const string& city, double dur, double p)
-        : clientName(client), cityName(city), duration(dur), price(p) {}
+    Currency currency;
+    time_t startTime;
+    // Списано с предоплаченного счёта в копейках по курсу на момент списания
+    bool prepaid = false;
+    long long chargedKopecks = 0;
+    Call(unsigned long long callId, const string& client, const string& city, double dur, double rate, Currency cur, time_t start)
+        : id(callId), clientName(client), cityName(city), duration(dur), pricePerMinute(rate), price(dur * rate), currency(cur), startTime(start) {}
+};
+
+// Неизменяемый сжатый архив старых звонков. Звонки хранятся блоками по столбцам:
+// имена клиентов и городов заменяются номерами из общего словаря, время начала - разностями
+// с предыдущим звонком, длительность и цена минуты - целыми числами как смещения от минимума блока.
+// Число знаков после запятой выбирается на блок так, чтобы значения восстанавливались точно;
+// если такого нет, хранится двоичное представление double. Стоимость не хранится, а считается
+// как длительность на цену минуты, так же, как у звонка в памяти, поэтому выгрузка и итоги
+// по архиву совпадают с итогами до архивации до последнего бита.
+// Для каждого блока хранятся минимум и максимум времени и сумма стоимости, поэтому запросы
+// за период пропускают неподходящие блоки и распаковывают только нужные столбцы.
+class CallArchive {
+public:
+    struct ArchivedCall {
+        unsigned long long id;
+        uint32_t client;
+        uint32_t city;
+        time_t startTime;
+        double duration;
+        double pricePerMinute;
+        double price;
+        Currency currency;
+    };
+
+private:
+    static constexpr size_t blockSize = 4096;
+
+    // Число с плавающей точкой в виде целых кодов: при scale >= 0 код - значение, умноженное на 10^scale
+    // (в zigzag), при rawBits - двоичное представление double; в data - смещения кодов от base
+    struct Column {
+        static constexpr int rawBits = -1;
+        int scale = rawBits;
+        uint64_t base = 0;
+        vector<uint8_t> data;
+    };
+
+    static constexpr int maxScale = 9;
+
+    struct Block {
+        size_t count = 0;
+        time_t minTime = 0;
+        time_t maxTime = 0;
+        CurrencyAmounts costSum = {};
+        vector<uint8_t> ids;
+        vector<uint8_t> clients;
+        vector<uint8_t> cities;
+        vector<uint8_t> times;
+        Column durations;
+        Column rates;
+        vector<uint8_t> currencies;
+    };
+
+    vector<string> dictionary;
+    unordered_map<string, uint32_t> dictionaryIndex;
+    vector<Block> blocks;
+    size_t callCount = 0;
+
+    static void putVarint(vector<uint8_t>& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    static uint64_t getVarint(const uint8_t*& in) {
+        uint64_t value = 0;
+        int shift = 0;
+        while (*in & 0x80) {
+            value |= static_cast<uint64_t>(*in++ & 0x7f) << shift;
+            shift += 7;
+        }
+        value |= static_cast<uint64_t>(*in++) << shift;
+        return value;
+    }
+
+    static uint64_t zigzag(long long value) {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    static long long unzigzag(uint64_t value) {
+        return static_cast<long long>(value >> 1) ^ -static_cast<long long>(value & 1);
+    }
+
+    static double powerOfTen(int scale) {
+        static const double powers[maxScale + 1] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+        return powers[scale];
+    }
+
+    // Код значения при заданном масштабе; false, если значение так не восстанавливается точно
+    static bool encodeValue(double value, int scale, uint64_t& code) {
+        if (scale == Column::rawBits) {
+            memcpy(&code, &value, sizeof(code));
+            return true;
+        }
+        const double scaled = value * powerOfTen(scale);
+        if (!(fabs(scaled) < 9007199254740992.0)) {
+            return false;
+        }
+        const long long integer = llround(scaled);
+        if (static_cast<double>(integer) / powerOfTen(scale) != value) {
+            return false;
+        }
+        code = zigzag(integer);
+        return true;
+    }
+
+    static double decodeValue(uint64_t code, int scale) {
+        if (scale == Column::rawBits) {
+            double value;
+            memcpy(&value, &code, sizeof(value));
+            return value;
+        }
+        return static_cast<double>(unzigzag(code)) / powerOfTen(scale);
+    }
+
+    // Наименьший масштаб, при котором все значения столбца восстанавливаются точно
+    static Column encodeColumn(const vector<double>& values) {
+        Column column;
+        vector<uint64_t> codes(values.size());
+        for (int scale = 0; scale <= maxScale && column.scale == Column::rawBits; ++scale) {
+            bool exact = true;
+            for (size_t i = 0; i < values.size() && exact; ++i) {
+                exact = encodeValue(values[i], scale, codes[i]);
+            }
+            if (exact) {
+                column.scale = scale;
+            }
+        }
+        if (column.scale == Column::rawBits) {
+            for (size_t i = 0; i < values.size(); ++i) {
+                encodeValue(values[i], Column::rawBits, codes[i]);
+            }
+        }
+        column.base = *min_element(codes.begin(), codes.end());
+        for (uint64_t code : codes) {
+            putVarint(column.data, code - column.base);
+        }
+        column.data.shrink_to_fit();
+        return column;
+    }
+
+    static double getValue(const Column& column, const uint8_t*& in) {
+        return decodeValue(column.base + getVarint(in), column.scale);
+    }
+
+    uint32_t encodeName(const string& name) {
+        auto it = dictionaryIndex.find(name);
+        if (it != dictionaryIndex.end()) {
+            return it->second;
+        }
+        uint32_t id = static_cast<uint32_t>(dictionary.size());
+        dictionary.push_back(name);
+        dictionaryIndex.emplace(name, id);
+        return id;
+    }
+
+    // Звонки должны быть упорядочены по времени начала
+    void appendBlock(const vector<const Call*>& sorted, size_t begin, size_t end) {
+        Block block;
+        block.count = end - begin;
+        block.minTime = sorted[begin]->startTime;
+        block.maxTime = sorted[end - 1]->startTime;
+        vector<double> durations;
+        vector<double> rates;
+        durations.reserve(block.count);
+        rates.reserve(block.count);
+
+        long long previousId = 0;
+        time_t previousTime = block.minTime;
+        for (size_t i = begin; i < end; ++i) {
+            const Call& call = *sorted[i];
+            long long id = static_cast<long long>(call.id);
+            putVarint(block.ids, zigzag(id - previousId));
+            previousId = id;
+            putVarint(block.clients, encodeName(call.clientName));
+            putVarint(block.cities, encodeName(call.cityName));
+            putVarint(block.times, static_cast<uint64_t>(call.startTime - previousTime));
+            previousTime = call.startTime;
+            durations.push_back(call.duration);
+            rates.push_back(call.pricePerMinute);
+            block.currencies.push_back(static_cast<uint8_t>(call.currency));
+            block.costSum[static_cast<size_t>(call.currency)] += call.price;
+        }
+        block.durations = encodeColumn(durations);
+        block.rates = encodeColumn(rates);
+
+        block.ids.shrink_to_fit();
+        block.clients.shrink_to_fit();
+        block.cities.shrink_to_fit();
+        block.times.shrink_to_fit();
+        block.currencies.shrink_to_fit();
+        blocks.push_back(move(block));
+    }
+
+public:
+    void append(vector<const Call*> archived) {
+        sort(archived.begin(), archived.end(), [](const Call* a, const Call* b) {
+            return a->startTime < b->startTime;
+        });
+        for (size_t begin = 0; begin < archived.size(); begin += blockSize) {
+            appendBlock(archived, begin, min(archived.size(), begin + blockSize));
+        }
+        callCount += archived.size();
+    }
+
+    size_t getCallsCount() const {
+        return callCount;
+    }
+
+    time_t getMaxTime() const {
+        time_t maxTime = numeric_limits<time_t>::min();
+        for (const auto& block : blocks) {
+            maxTime = max(maxTime, block.maxTime);
+        }
+        return maxTime;
+    }
+
+    size_t getMemoryUsage() const {
+        size_t bytes = blocks.size() * sizeof(Block);
+        for (const auto& block : blocks) {
+            bytes += block.ids.size() + block.clients.size() + block.cities.size()
+                + block.times.size() + block.durations.data.size() + block.rates.data.size() + block.currencies.size();
+        }
+        for (const auto& name : dictionary) {
+            bytes += name.size() + sizeof(string) + sizeof(uint32_t);
+        }
+        return bytes;
+    }
+
+    const string& getName(uint32_t id) const {
+        return dictionary[id];
+    }
+
+    // Выручка по валютам за звонки с временем начала в [from, to]
+    CurrencyAmounts getRevenue(time_t from, time_t to) const {
+        CurrencyAmounts revenue = {};
+        for (const auto& block : blocks) {
+            if (block.maxTime < from || block.minTime > to) {
+                continue;
+            }
+            if (block.minTime >= from && block.maxTime <= to) {
+                for (size_t c = 0; c < currencyCount; ++c) {
+                    revenue[c] += block.costSum[c];
+                }
+                continue;
+            }
+
+            // Блок пересекается с периодом частично: распаковываем только время, длительность, цену и валюту
+            const uint8_t* times = block.times.data();
+            const uint8_t* durations = block.durations.data.data();
+            const uint8_t* rates = block.rates.data.data();
+            time_t startTime = block.minTime;
+            for (size_t i = 0; i < block.count; ++i) {
+                startTime += static_cast<time_t>(getVarint(times));
+                double duration = getValue(block.durations, durations);
+                double pricePerMinute = getValue(block.rates, rates);
+                if (startTime >= from && startTime <= to) {
+                    revenue[block.currencies[i]] += duration * pricePerMinute;
+                }
+            }
+        }
+        return revenue;
+    }
+
+    size_t getBlockCount() const {
+        return blocks.size();
+    }
+
+    // Распаковка одного блока; звонки передаются в visitor по одному
+    template <typename Visitor>
+    void forEachInBlock(size_t blockIndex, Visitor visitor) const {
+        const Block& block = blocks[blockIndex];
+        const uint8_t* ids = block.ids.data();
+        const uint8_t* clients = block.clients.data();
+        const uint8_t* cities = block.cities.data();
+        const uint8_t* times = block.times.data();
+        const uint8_t* durations = block.durations.data.data();
+        const uint8_t* rates = block.rates.data.data();
+        long long id = 0;
+        time_t startTime = block.minTime;
+        for (size_t i = 0; i < block.count; ++i) {
+            ArchivedCall call;
+            id += unzigzag(getVarint(ids));
+            call.id = static_cast<unsigned long long>(id);
+            call.client = static_cast<uint32_t>(getVarint(clients));
+            call.city = static_cast<uint32_t>(getVarint(cities));
+            startTime += static_cast<time_t>(getVarint(times));
+            call.startTime = startTime;
+            call.duration = getValue(block.durations, durations);
+            call.pricePerMinute = getValue(block.rates, rates);
+            call.price = call.duration * call.pricePerMinute;
+            call.currency = static_cast<Currency>(block.currencies[i]);
+            visitor(call);
+        }
+    }
+
+    // Попадает ли хотя бы часть блока в период [from, to] (по зоне времени)
+    bool blockOverlaps(size_t blockIndex, time_t from, time_t to) const {
+        return blocks[blockIndex].maxTime >= from && blocks[blockIndex].minTime <= to;
+    }
+};
+
+// Признаки подозрительного звонка (битовая маска)
+enum FraudFlag : unsigned {
+    SpendSpike = 1,
+    HighCallRate = 2,
+    PremiumAbuse = 4
+};
+
+// Обнаружение аномалий в потоке звонков. Для каждого клиента хранятся экспоненциально сглаженная
+// средняя стоимость звонка и скользящее окно из нескольких корзин с числом звонков,
+// поэтому проверка одного звонка занимает постоянное время и не зависит от истории клиента.
+class FraudDetector {
+private:
+    static constexpr int bucketCount = 6;
+    static constexpr time_t bucketSeconds = 600; // окно - последний час
+
+    struct ClientActivity {
+        double costEwma = 0;
+        unsigned long long callsSeen = 0;
+        long long bucketEpoch[bucketCount] = {};
+        unsigned short calls[bucketCount] = {};
+        unsigned short premiumCalls[bucketCount] = {};
+    };
+
+    unordered_map<string, ClientActivity> activity;
+
+    double ewmaAlpha = 0.1;
+    double spikeFactor = 5.0;
+    unsigned long long warmupCalls = 5;
+    unsigned maxCallsPerWindow = 30;
+    unsigned maxPremiumCallsPerWindow = 5;
+    double premiumPrice = 50.0;
+
+public:
+    unsigned check(const string& clientName, double pricePerMinute, double cost, time_t startTime) {
+        ClientActivity& client = activity[clientName];
+        unsigned flags = 0;
+
+        if (client.callsSeen >= warmupCalls && cost > spikeFactor * client.costEwma) {
+            flags |= SpendSpike;
+        }
+        client.costEwma = client.callsSeen == 0 ? cost : client.costEwma + ewmaAlpha * (cost - client.costEwma);
+        ++client.callsSeen;
+
+        // Деление с округлением вниз и неотрицательный остаток: время до 1970 года не выводит за границы корзин
+        long long epoch = startTime / bucketSeconds - (startTime % bucketSeconds < 0 ? 1 : 0);
+        int slot = static_cast<int>((epoch % bucketCount + bucketCount) % bucketCount);
+        if (client.bucketEpoch[slot] < epoch) {
+            client.bucketEpoch[slot] = epoch;
+            client.calls[slot] = 0;
+            client.premiumCalls[slot] = 0;
+        }
+        if (client.bucketEpoch[slot] != epoch) {
+            // Звонок старше окна: учитывается только в средней стоимости
+            return flags;
+        }
+        if (client.calls[slot] < numeric_limits<unsigned short>::max()) {
+            ++client.calls[slot];
+        }
+        if (pricePerMinute >= premiumPrice && client.premiumCalls[slot] < numeric_limits<unsigned short>::max()) {
+            ++client.premiumCalls[slot];
+        }
+
+        unsigned windowCalls = 0;
+        unsigned windowPremiumCalls = 0;
+        for (int i = 0; i < bucketCount; ++i) {
+            if (epoch - client.bucketEpoch[i] < bucketCount) {
+                windowCalls += client.calls[i];
+                windowPremiumCalls += client.premiumCalls[i];
+            }
+        }
+        if (windowCalls > maxCallsPerWindow) {
+            flags |= HighCallRate;
+        }
+        if (windowPremiumCalls > maxPremiumCallsPerWindow) {
+            flags |= PremiumAbuse;
+        }
+        return flags;
+    }
+
+    // Перенос состояния клиентов из детектора с непересекающимся набором клиентов
+    void merge(FraudDetector& other) {
+        activity.merge(other.activity);
+    }
+};
+
+struct FraudAlert {
+    unsigned long long callId;
+    string clientName;
+    unsigned flags;
+};
+
+// Предоплаченные счета клиентов. Баланс хранится в копейках в атомарной ячейке, выровненной по строке кэша,
+// поэтому списания с разных счетов не мешают друг другу, а списания с одного счёта не требуют блокировки.
+// Открытие счетов не потокобезопасно; работа с уже открытыми счетами - потокобезопасна.
+class PrepaidAccounts {
+public:
+    struct alignas(64) Account {
+        atomic<long long> balance{ 0 };
+
+        // Списание только при достаточном балансе
+        bool tryDebit(long long amount) {
+            long long current = balance.load(memory_order_relaxed);
+            do {
+                if (current < amount) {
+                    return false;
+                }
+            } while (!balance.compare_exchange_weak(current, current - amount, memory_order_acq_rel, memory_order_relaxed));
+            return true;
+        }
+
+        // Зачисление или безусловная корректировка (при отрицательной сумме)
+        void credit(long long amount) {
+            balance.fetch_add(amount, memory_order_acq_rel);
+        }
+    };
+
+private:
+    unordered_map<string, unique_ptr<Account>> accounts;
+
+public:
+    static long long toKopecks(double amount) {
+        return llround(amount * 100);
+    }
+
+    Account& open(const string& clientName) {
+        auto& account = accounts[clientName];
+        if (!account) {
+            account = make_unique<Account>();
+        }
+        return *account;
+    }
+
+    Account* find(const string& clientName) {
+        auto it = accounts.find(clientName);
+        return it != accounts.end() ? it->second.get() : nullptr;
+    }
+
+    const Account* find(const string& clientName) const {
+        auto it = accounts.find(clientName);
+        return it != accounts.end() ? it->second.get() : nullptr;
+    }
+
+    bool empty() const {
+        return accounts.empty();
+    }
+
+    // Перенос счетов с непересекающимся набором клиентов: счёт клиента, который уже есть здесь,
+    // остаётся в other. Не потокобезопасно, как и открытие счетов.
+    void merge(PrepaidAccounts& other) {
+        accounts.merge(other.accounts);
+    }
+};
+
+// Разреженная матрица "клиент - направление": для каждой пары хранится число звонков и их суммарная
+// длительность. Свежие изменения копятся в коротких строках по клиентам (дельта), а при уплотнении
+// сливаются в CSR - плоские массивы рёбер, упорядоченные по клиенту и направлению; транспонированный
+// индекс по направлениям строится из CSR по запросу. Запросы объединяют CSR с дельтой, поэтому
+// уплотнение можно делать редко: оно запускается само, когда дельта дорастает до размера CSR.
+// Номера рёбер 32-битные, то есть матрица рассчитана на число рёбер до 4 млрд.
+class UsageMatrix {
+public:
+    struct Usage {
+        long long calls = 0;
+        double minutes = 0;
+    };
+
+    struct RouteUsage {
+        string name;
+        long long calls;
+        double minutes;
+    };
+
+private:
+    static constexpr size_t minCompactionSize = 1 << 16;
+
+    // Имена заменяются номерами, чтобы ребро CSR занимало 16 байт
+    unordered_map<string, uint32_t> clientIds;
+    unordered_map<string, uint32_t> cityIds;
+    vector<string> clientNames;
+    vector<string> cityNames;
+
+    // Рёбра клиента i занимают [rowStart[i], rowStart[i + 1]) и упорядочены по номеру направления
+    vector<uint32_t> rowStart = { 0 };
+    vector<uint32_t> columns;
+    vector<uint32_t> callCounts;
+    vector<double> minutes;
+
+    // Рёбра направления j: columnEdges[columnStart[j] .. columnStart[j + 1]), по возрастанию номера клиента.
+    // Транспонированный индекс строится при первом запросе по направлению после уплотнения
+    mutable vector<uint32_t> columnStart;
+    mutable vector<uint32_t> columnRows;
+    mutable vector<uint32_t> columnEdges;
+    mutable bool columnIndexValid = false;
+
+    // Изменения после последнего уплотнения по номеру клиента. Строка дельты короткая (направления,
+    // затронутые с прошлого уплотнения), поэтому поиск в ней линейный, без узлов хеш-таблицы на каждое ребро
+    vector<vector<pair<uint32_t, Usage>>> deltaRows;
+    vector<uint32_t> dirtyRows;
+    size_t deltaSize = 0;
+
+    template <typename Row>
+    static auto findDelta(Row& row, uint32_t column) -> decltype(&row.front().second) {
+        for (auto& entry : row) {
+            if (entry.first == column) {
+                return &entry.second;
+            }
+        }
+        return nullptr;
+    }
+
+    static uint32_t intern(const string& name, unordered_map<string, uint32_t>& ids, vector<string>& names) {
+        auto it = ids.find(name);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        uint32_t id = static_cast<uint32_t>(names.size());
+        ids.emplace(name, id);
+        names.push_back(name);
+        return id;
+    }
+
+    pair<uint32_t, uint32_t> rowRange(uint32_t row) const {
+        if (static_cast<size_t>(row) + 1 >= rowStart.size()) {
+            return { 0, 0 };
+        }
+        return { rowStart[row], rowStart[row + 1] };
+    }
+
+    // Добавляет приращение к элементу с ключом key: первые sortedCount элементов упорядочены и ищутся
+    // двоичным поиском, ключи из дельты, которых нет в CSR, дописываются в конец
+    static void mergeEntry(vector<pair<uint32_t, Usage>>& entries, size_t sortedCount, uint32_t key, const Usage& usage) {
+        auto end = entries.begin() + sortedCount;
+        auto it = lower_bound(entries.begin(), end, key, [](const pair<uint32_t, Usage>& entry, uint32_t value) {
+            return entry.first < value;
+        });
+        if (it != end && it->first == key) {
+            it->second.calls += usage.calls;
+            it->second.minutes += usage.minutes;
+            return;
+        }
+        entries.push_back({ key, usage });
+    }
+
+    static vector<RouteUsage> top(vector<pair<uint32_t, Usage>>& entries, const vector<string>& names, size_t limit) {
+        entries.erase(remove_if(entries.begin(), entries.end(), [](const pair<uint32_t, Usage>& entry) {
+            return entry.second.calls <= 0;
+        }), entries.end());
+        size_t count = min(limit, entries.size());
+        partial_sort(entries.begin(), entries.begin() + count, entries.end(),
+            [](const pair<uint32_t, Usage>& a, const pair<uint32_t, Usage>& b) {
+                if (a.second.minutes != b.second.minutes) {
+                    return a.second.minutes > b.second.minutes;
+                }
+                return a.first < b.first;
+            });
+        vector<RouteUsage> result;
+        result.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            result.push_back({ names[entries[i].first], entries[i].second.calls, entries[i].second.minutes });
+        }
+        return result;
+    }
+
+    // Транспонирование подсчётом: строки обходятся по возрастанию, поэтому внутри направления клиенты упорядочены
+    void buildColumnIndex() const {
+        if (columnIndexValid) {
+            return;
+        }
+        const uint32_t rowCount = static_cast<uint32_t>(rowStart.size() - 1);
+        columnStart.assign(cityNames.size() + 1, 0);
+        for (uint32_t column : columns) {
+            ++columnStart[column + 1];
+        }
+        for (size_t i = 1; i < columnStart.size(); ++i) {
+            columnStart[i] += columnStart[i - 1];
+        }
+        columnRows.resize(columns.size());
+        columnEdges.resize(columns.size());
+        vector<uint32_t> fill(columnStart.begin(), columnStart.end() - 1);
+        for (uint32_t row = 0; row < rowCount; ++row) {
+            for (uint32_t edge = rowStart[row]; edge < rowStart[row + 1]; ++edge) {
+                uint32_t position = fill[columns[edge]]++;
+                columnRows[position] = row;
+                columnEdges[position] = edge;
+            }
+        }
+        columnIndexValid = true;
+    }
+
+public:
+    // Учёт изменения звонка: +1 звонок при регистрации, -1 при удалении, 0 при исправлении длительности
+    void record(const string& clientName, const string& cityName, long long callsDelta, double minutesDelta) {
+        uint32_t row = intern(clientName, clientIds, clientNames);
+        uint32_t column = intern(cityName, cityIds, cityNames);
+        if (row >= deltaRows.size()) {
+            deltaRows.resize(clientNames.size());
+        }
+        vector<pair<uint32_t, Usage>>& deltaRow = deltaRows[row];
+        if (deltaRow.empty()) {
+            dirtyRows.push_back(row);
+        }
+        Usage* entry = findDelta(deltaRow, column);
+        if (!entry) {
+            deltaRow.push_back({ column, Usage() });
+            entry = &deltaRow.back().second;
+            ++deltaSize;
+        }
+        entry->calls += callsDelta;
+        entry->minutes += minutesDelta;
+        if (deltaSize > max(minCompactionSize, columns.size())) {
+            compact();
+        }
+    }
+
+    // Слияние дельты с CSR и перестроение транспонированного индекса; O(рёбер + дельты · log)
+    void compact() {
+        if (dirtyRows.empty()) {
+            return;
+        }
+        const uint32_t rowCount = static_cast<uint32_t>(clientNames.size());
+        vector<uint32_t> newRowStart(static_cast<size_t>(rowCount) + 1, 0);
+        vector<uint32_t> newColumns;
+        vector<uint32_t> newCallCounts;
+        vector<double> newMinutes;
+        newColumns.reserve(columns.size() + deltaSize);
+        newCallCounts.reserve(columns.size() + deltaSize);
+        newMinutes.reserve(columns.size() + deltaSize);
+
+        for (uint32_t row = 0; row < rowCount; ++row) {
+            auto range = rowRange(row);
+            if (row >= deltaRows.size() || deltaRows[row].empty()) {
+                newColumns.insert(newColumns.end(), columns.begin() + range.first, columns.begin() + range.second);
+                newCallCounts.insert(newCallCounts.end(), callCounts.begin() + range.first, callCounts.begin() + range.second);
+                newMinutes.insert(newMinutes.end(), minutes.begin() + range.first, minutes.begin() + range.second);
+                newRowStart[row + 1] = static_cast<uint32_t>(newColumns.size());
+                continue;
+            }
+
+            vector<pair<uint32_t, Usage>>& pending = deltaRows[row];
+            sort(pending.begin(), pending.end(), [](const pair<uint32_t, Usage>& a, const pair<uint32_t, Usage>& b) {
+                return a.first < b.first;
+            });
+            uint32_t edge = range.first;
+            size_t next = 0;
+            while (edge < range.second || next < pending.size()) {
+                uint32_t column;
+                Usage usage;
+                if (next == pending.size() || (edge < range.second && columns[edge] < pending[next].first)) {
+                    column = columns[edge];
+                    usage = { callCounts[edge], minutes[edge] };
+                    ++edge;
+                }
+                else {
+                    column = pending[next].first;
+                    usage = pending[next].second;
+                    if (edge < range.second && columns[edge] == column) {
+                        usage.calls += callCounts[edge];
+                        usage.minutes += minutes[edge];
+                        ++edge;
+                    }
+                    ++next;
+                }
+                if (usage.calls > 0) {
+                    newColumns.push_back(column);
+                    newCallCounts.push_back(static_cast<uint32_t>(usage.calls));
+                    newMinutes.push_back(usage.minutes);
+                }
+            }
+            newRowStart[row + 1] = static_cast<uint32_t>(newColumns.size());
+        }
+
+        rowStart.swap(newRowStart);
+        columns.swap(newColumns);
+        callCounts.swap(newCallCounts);
+        minutes.swap(newMinutes);
+        for (uint32_t row : dirtyRows) {
+            deltaRows[row].clear();
+        }
+        dirtyRows.clear();
+        deltaSize = 0;
+        columnIndexValid = false;
+    }
+
+    // Направления клиента по убыванию суммарной длительности
+    vector<RouteUsage> topCities(const string& clientName, size_t limit) const {
+        auto id = clientIds.find(clientName);
+        if (id == clientIds.end()) {
+            return {};
+        }
+        auto range = rowRange(id->second);
+        vector<pair<uint32_t, Usage>> entries;
+        entries.reserve(range.second - range.first);
+        for (uint32_t edge = range.first; edge < range.second; ++edge) {
+            entries.push_back({ columns[edge], { callCounts[edge], minutes[edge] } });
+        }
+        if (id->second < deltaRows.size()) {
+            const size_t sortedCount = entries.size();
+            for (const auto& item : deltaRows[id->second]) {
+                mergeEntry(entries, sortedCount, item.first, item.second);
+            }
+        }
+        return top(entries, cityNames, limit);
+    }
+
+    // Клиенты направления по убыванию суммарной длительности
+    vector<RouteUsage> topClients(const string& cityName, size_t limit) const {
+        auto id = cityIds.find(cityName);
+        if (id == cityIds.end()) {
+            return {};
+        }
+        const uint32_t column = id->second;
+        buildColumnIndex();
+        vector<pair<uint32_t, Usage>> entries;
+        if (static_cast<size_t>(column) + 1 < columnStart.size()) {
+            entries.reserve(columnStart[column + 1] - columnStart[column]);
+            for (uint32_t i = columnStart[column]; i < columnStart[column + 1]; ++i) {
+                uint32_t edge = columnEdges[i];
+                entries.push_back({ columnRows[i], { callCounts[edge], minutes[edge] } });
+            }
+        }
+        const size_t sortedCount = entries.size();
+        for (uint32_t row : dirtyRows) {
+            if (const Usage* item = findDelta(deltaRows[row], column)) {
+                mergeEntry(entries, sortedCount, row, *item);
+            }
+        }
+        return top(entries, clientNames, limit);
+    }
+
+    // Добавление всех рёбер другой матрицы
+    void merge(const UsageMatrix& other) {
+        for (uint32_t row = 0; row + 1 < other.rowStart.size(); ++row) {
+            for (uint32_t edge = other.rowStart[row]; edge < other.rowStart[row + 1]; ++edge) {
+                record(other.clientNames[row], other.cityNames[other.columns[edge]], other.callCounts[edge], other.minutes[edge]);
+            }
+        }
+        for (uint32_t row : other.dirtyRows) {
+            for (const auto& entry : other.deltaRows[row]) {
+                record(other.clientNames[row], other.cityNames[entry.first], entry.second.calls, entry.second.minutes);
+            }
+        }
+    }
+
+    size_t getEdgeCount() const {
+        return columns.size();
+    }
+
+    size_t getDeltaSize() const {
+        return deltaSize;
+    }
+
+    static void print(const vector<RouteUsage>& routes) {
+        ReportWriter writer(ReportFormat::Text, {
+            { "name", "", " | ", 0 },
+            { "calls", "", " | ", 0 },
+            { "minutes", "", "", moneyPrecision }
+        });
+        if (routes.empty()) {
+            writer.text("Звонков нет.\n");
+        }
+        else {
+            writer.text("Название | Звонков | Минут\n");
+        }
+        for (const auto& route : routes) {
+            writer.add(route.name);
+            writer.add(static_cast<unsigned long long>(route.calls));
+            writer.add(route.minutes);
+            writer.endRow();
+        }
+        writer.flush(cout);
+    }
+};
+
+// Журнал событий АТС в виде команд пакетного режима (см. CommandInterpreter): его можно выполнить
+// как обычный скрипт или восстановить по нему АТС параллельно (--replay). Числа пишутся кратчайшей
+// записью, которая читается обратно без потери точности; имена - в кавычках.
+class EventRecorder {
+private:
+    static constexpr size_t flushSize = 1 << 16;
+
+    unique_ptr<ofstream> file;
+    string buffer;
+
+public:
+    ~EventRecorder() {
+        flush();
+    }
+
+    // Журнал дописывается в конец файла, чтобы запись можно было продолжить после перезапуска
+    bool open(const string& fileName) {
+        close();
+        file = make_unique<ofstream>(fileName, ios::binary | ios::app);
+        if (!*file) {
+            file.reset();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        flush();
+        file.reset();
+    }
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    EventRecorder& command(string_view name) {
+        buffer.append(name);
+        return *this;
+    }
+
+    EventRecorder& quoted(string_view text) {
+        buffer += " \"";
+        buffer.append(text);
+        buffer += '"';
+        return *this;
+    }
+
+    EventRecorder& number(double value) {
+        char digits[32];
+        buffer += ' ';
+        buffer.append(digits, to_chars(digits, digits + sizeof(digits), value).ptr);
+        return *this;
+    }
+
+    EventRecorder& number(long long value) {
+        char digits[24];
+        buffer += ' ';
+        buffer.append(digits, to_chars(digits, digits + sizeof(digits), value).ptr);
+        return *this;
+    }
+
+    EventRecorder& number(unsigned long long value) {
+        char digits[24];
+        buffer += ' ';
+        buffer.append(digits, to_chars(digits, digits + sizeof(digits), value).ptr);
+        return *this;
+    }
+
+    EventRecorder& word(string_view text) {
+        buffer += ' ';
+        buffer.append(text);
+        return *this;
+    }
+
+    void end() {
+        buffer += '\n';
+        if (buffer.size() >= flushSize) {
+            flush();
+        }
+    }
+
+    void flush() {
+        if (file && !buffer.empty()) {
+            file->write(buffer.data(), static_cast<streamsize>(buffer.size()));
+            file->flush();
+        }
+        buffer.clear();
+    }
+};
+
+// Каждая АТС выравнивается по строке кэша, чтобы данные соседних арендаторов не делили одну строку
+class alignas(64) ATC {
+private:
+    string name;
+    vector<Tariff> tariffs;
+    vector<Call> calls;
+
+    // Номер тарифа по названию направления; при повторах используется первый добавленный тариф
+    unordered_map<string, int> tariffByCity;
+    CurrencyAmounts totalRevenue = {};
+    unsigned long long nextCallId = 1;
+
+    // Сумма стоимости звонков по каждому клиенту; обновляется приращениями при любом изменении звонков
+    unordered_map<string, CurrencyAmounts> clientTotals;
+
+    ExchangeRates rates;
+
+    FraudDetector fraudDetector;
+    vector<FraudAlert> fraudAlerts;
+
+    PrepaidAccounts prepaid;
+
+    // Кто куда звонит: число звонков и минуты по парам клиент - направление
+    UsageMatrix usage;
+
+    // Звонки, перенесённые из calls в сжатый архив; изменять и перетарифицировать их нельзя
+    CallArchive archive;
+
+    // Журнал событий, меняющих итоги: тарифы, курсы, звонки, их исправления и пополнения счетов
+    EventRecorder recorder;
+
+    // Подтверждения операций в консоль; отключаются у частей при параллельном восстановлении
+    bool verbose = true;
 
-    ~Call() {
-        cout << "Деструктор для звонка: " << clientName << " -> " << cityName << endl;
+#ifndef _WIN32
+    // Общая таблица тарифов других процессов; если задана, цены для тарификации берутся из неё
+    const SharedTariffTable* sharedTariffs = nullptr;
+#endif
+
+    // Индекс сортировки тарифов; перестраивается только после изменения списка тарифов
+    mutable vector<size_t> sortIndex;
+    mutable TariffSort sortIndexOrder = TariffSort::ByName;
+    mutable bool sortIndexValid = false;
+
+    const vector<size_t>& getSortIndex(TariffSort order) const {
+        if (sortIndexValid && sortIndexOrder == order) {
+            return sortIndex;
+        }
+        sortIndex.resize(tariffs.size());
+        for (size_t i = 0; i < tariffs.size(); ++i) {
+            sortIndex[i] = i;
+        }
+        if (order == TariffSort::ByName) {
+            stable_sort(sortIndex.begin(), sortIndex.end(), [this](size_t a, size_t b) {
+                return tariffs[a].cityName < tariffs[b].cityName;
+            });
+        }
+        else {
+            stable_sort(sortIndex.begin(), sortIndex.end(), [this](size_t a, size_t b) {
+                return tariffs[a].price < tariffs[b].price;
+            });
+        }
+        sortIndexOrder = order;
+        sortIndexValid = true;
+        return sortIndex;
+    }
+
+public:
+    explicit ATC(const string& tenantName) : name(tenantName) {}
+
+    ATC(const ATC&) = delete;
+    ATC& operator=(const ATC&) = delete;
+
+    ~ATC() {
+        stopRecording();
+        cout << "Деструктор для ATC " << name << "\n";
+    }
+
+    const string& getName() const {
+        return name;
+    }
+
+    void setVerbose(bool enabled) {
+        verbose = enabled;
+    }
+
+    const vector<Tariff>& getTariffs() const {
+        return tariffs;
+    }
+
+    void addTariff(const string& cityName, double price, Currency currency = Currency::RUB) {
+        tariffs.emplace_back(cityName, price, currency);
+        tariffByCity.emplace(cityName, static_cast<int>(tariffs.size() - 1));
+        sortIndexValid = false;
+        if (recorder.isOpen()) {
+            recorder.command("tariff").quoted(cityName).number(price).word(currencyCode(currency)).end();
+        }
+        if (!verbose) {
+            return;
+        }
+        cout << "Тариф добавлен успешно: " << cityName << " по цене " << price << " " << currencyCode(currency) << " за минуту\n";
+    }
+
+    const ExchangeRates& getRates() const {
+        return rates;
+    }
+
+    bool setExchangeRate(Currency currency, double rubles) {
+        if (!rates.setRate(currency, rubles)) {
+            return false;
+        }
+        if (recorder.isOpen()) {
+            recorder.command("exchange").word(currencyCode(currency)).number(rubles).end();
+        }
+        return true;
+    }
+
+    static vector<ReportWriter::Column> tariffColumns() {
+        return {
+            { "number", "", ". ", 0 },
+            { "city", "", " - ", 0 },
+            { "price", "", " ", -1 },
+            { "currency", "", " за минуту", 0 }
+        };
+    }
+
+    void writeTariff(ReportWriter& writer, size_t index) const {
+        writer.add(static_cast<unsigned long long>(index + 1));
+        writer.add(tariffs[index].cityName);
+        writer.add(tariffs[index].price);
+        writer.add(currencyCode(tariffs[index].currency));
+        writer.endRow();
+    }
+
+    int printTariffs() const {
+        ReportWriter writer(ReportFormat::Text, tariffColumns());
+        writer.text("Список тарифов:\n");
+        if (tariffs.empty()) {
+            writer.text("Список тарифов пуст.\n");
+        }
+        for (size_t i = 0; i < tariffs.size(); ++i) {
+            writeTariff(writer, i);
+        }
+        writer.flush(cout);
+        return static_cast<int>(tariffs.size());
+    }
+
+    void exportTariffs(ostream& out, ReportFormat format) const {
+        ReportWriter writer(format, tariffColumns());
+        for (size_t i = 0; i < tariffs.size(); ++i) {
+            writeTariff(writer, i);
+        }
+        writer.flush(out);
+    }
+
+    // Вывод одной страницы отсортированного списка тарифов с поиском по названию.
+    // cursor - позиция в индексе сортировки, с которой начинается страница;
+    // возвращает позицию для следующей страницы или tariffs.size(), если список закончился.
+    // Номера в списке совпадают с номерами из printTariffs.
+    size_t printTariffsPage(TariffSort order, const string& filter, bool prefixOnly, size_t cursor, size_t pageSize) const {
+        const vector<size_t>& index = getSortIndex(order);
+
+        // Для поиска по началу названия в списке, отсортированном по названию, сразу переходим к первому совпадению
+        if (prefixOnly && order == TariffSort::ByName && cursor == 0 && !filter.empty()) {
+            cursor = lower_bound(index.begin(), index.end(), filter, [this](size_t i, const string& key) {
+                return tariffs[i].cityName < key;
+            }) - index.begin();
+        }
+
+        ReportWriter writer(ReportFormat::Text, tariffColumns());
+        size_t printed = 0;
+        for (; cursor < index.size() && printed < pageSize; ++cursor) {
+            const Tariff& tariff = tariffs[index[cursor]];
+            if (!filter.empty()) {
+                if (prefixOnly) {
+                    if (tariff.cityName.compare(0, filter.size(), filter) != 0) {
+                        if (order == TariffSort::ByName) {
+                            cursor = index.size();
+                            break;
+                        }
+                        continue;
+                    }
+                }
+                else if (tariff.cityName.find(filter) == string::npos) {
+                    continue;
+                }
+            }
+
+            writeTariff(writer, index[cursor]);
+            ++printed;
+        }
+
+        if (printed == 0) {
+            writer.text("Подходящих тарифов нет.\n");
+        }
+        writer.flush(cout);
+        return cursor;
+    }
+
+    // Номер тарифа направления или -1, если тарифа нет
+    int findTariff(const string& cityName) const {
+        auto it = tariffByCity.find(cityName);
+        return it == tariffByCity.end() ? -1 : it->second;
+    }
+
+    // Цена и валюта направления для тарификации: из общей таблицы, если АТС к ней подключена,
+    // иначе из своих тарифов. Занятая дольше таймаута общая таблица считается недоступной.
+    bool findRate(const string& cityName, double& price, Currency& currency) const {
+#ifndef _WIN32
+        if (sharedTariffs) {
+            uint64_t generation;
+            return sharedTariffs->lookup(cityName, price, currency, generation) == SharedTariffTable::ReadStatus::Found;
+        }
+#endif
+        int index = findTariff(cityName);
+        if (index < 0) {
+            return false;
+        }
+        price = tariffs[index].price;
+        currency = tariffs[index].currency;
+        return true;
+    }
+
+#ifndef _WIN32
+    // nullptr - тарифицировать по своим тарифам
+    void useSharedTariffs(const SharedTariffTable* table) {
+        sharedTariffs = table;
+    }
+
+    bool isUsingSharedTariffs() const {
+        return sharedTariffs != nullptr;
+    }
+#endif
+
+    // Свои тарифы в виде строк для публикации в общую таблицу
+    vector<TariffRow> getTariffRows() const {
+        vector<TariffRow> rows;
+        rows.reserve(tariffs.size());
+        for (const auto& tariff : tariffs) {
+            rows.push_back({ tariff.cityName, tariff.price, tariff.price, tariff.currency });
+        }
+        return rows;
+    }
+
+    double getFarePrice(int index) const {
+        if (index >= 0 && index < tariffs.size()) {
+            return tariffs[index].price;
+        }
+        return 0.0;
+    }
+
+
+    // Тарификация звонка без вывода на экран (используется генератором нагрузки).
+    // Для клиента с предоплаченным (рублёвым) счётом стоимость сначала списывается со счёта;
+    // если средств не хватает, звонок отклоняется и функция возвращает false.
+    bool rateCall(const string& clientName, const string& cityName, double duration, double pricePerMinute, time_t startTime,
+        Currency currency = Currency::RUB) {
+        const double rubPerUnit = rates.getRate(currency);
+        PrepaidAccounts::Account* account = prepaid.find(clientName);
+        const long long charge = PrepaidAccounts::toKopecks(duration * pricePerMinute * rubPerUnit);
+        if (account && !account->tryDebit(charge)) {
+            return false;
+        }
+
+        calls.emplace_back(nextCallId++, clientName, cityName, duration, pricePerMinute, currency, startTime);
+        if (account) {
+            calls.back().prepaid = true;
+            calls.back().chargedKopecks = charge;
+        }
+        double totalCost = calls.back().price;
+        totalRevenue[static_cast<size_t>(currency)] += totalCost;
+        clientTotals[clientName][static_cast<size_t>(currency)] += totalCost;
+        usage.record(clientName, cityName, 1, duration);
+
+        unsigned flags = fraudDetector.check(clientName, pricePerMinute * rubPerUnit, totalCost * rubPerUnit, startTime);
+        if (flags != 0) {
+            fraudAlerts.push_back({ calls.back().id, clientName, flags });
+        }
+        if (recorder.isOpen()) {
+            recorder.command("call").quoted(clientName).quoted(cityName).number(duration)
+                .number(static_cast<long long>(startTime)).number(calls.back().id);
+            // Цена пишется, только если звонок оценён не по текущему тарифу направления: тогда
+            // исправленный в журнале тариф при восстановлении переоценит все звонки по нему
+            int index = findTariff(cityName);
+            if (index < 0 || tariffs[index].price != pricePerMinute || tariffs[index].currency != currency) {
+                recorder.number(pricePerMinute).word(currencyCode(currency));
+            }
+            recorder.end();
+        }
+        return true;
+    }
+
+    bool registerCall(const string& clientName, const string& cityName, double duration, double pricePerMinute,
+        Currency currency = Currency::RUB) {
+        if (duration < 0 || pricePerMinute < 0) {
+            cout << "Звонок отклонён: продолжительность и цена не могут быть отрицательными.\n";
+            return false;
+        }
+        size_t alertsBefore = fraudAlerts.size();
+        if (!rateCall(clientName, cityName, duration, pricePerMinute, time(nullptr), currency)) {
+            cout << "Звонок отклонён: недостаточно средств на счёте клиента " << clientName << ".\n";
+            return false;
+        }
+        ReportWriter writer;
+        writer.text("Звонок №").number(calls.back().id).text(" зарегистрирован: ").text(clientName).text(" -> ").text(cityName)
+            .text(", стоимость: ").number(calls.back().price, moneyPrecision).text(" ").text(currencyCode(currency)).text("\n");
+        if (fraudAlerts.size() != alertsBefore) {
+            writer.text("Внимание: звонок помечен как подозрительный.\n");
+        }
+        writer.flush(cout);
+        return true;
+    }
+
+    void printFraudAlerts() const {
+        if (fraudAlerts.empty()) {
+            cout << "Подозрительных звонков нет.\n";
+            return;
+        }
+        string out;
+        char number[32];
+        for (const auto& alert : fraudAlerts) {
+            out += "Звонок №";
+            out.append(number, to_chars(number, number + sizeof(number), alert.callId).ptr);
+            out += " (";
+            out += alert.clientName;
+            out += "):";
+            if (alert.flags & SpendSpike) {
+                out += " резкий рост расходов;";
+            }
+            if (alert.flags & HighCallRate) {
+                out += " слишком частые звонки;";
+            }
+            if (alert.flags & PremiumAbuse) {
+                out += " много звонков на дорогие направления;";
+            }
+            out += '\n';
+        }
+        cout.write(out.data(), out.size());
+    }
+
+    // Изменение стоимости уже списанных звонков переносится на предоплаченный счёт (баланс может уйти в минус)
+    // Новая стоимость звонка списывается с предоплаченного счёта по текущему курсу, а прежнее
+    // списание возвращается ровно в той сумме, что была списана (курс мог измениться)
+    void rechargePrepaid(Call& call) {
+        if (!call.prepaid) {
+            return;
+        }
+        long long charge = PrepaidAccounts::toKopecks(call.price * rates.getRate(call.currency));
+        if (PrepaidAccounts::Account* account = prepaid.find(call.clientName)) {
+            account->credit(call.chargedKopecks - charge);
+        }
+        call.chargedKopecks = charge;
+    }
+
+    void topUpPrepaid(const string& clientName, double amount) {
+        prepaid.open(clientName).credit(PrepaidAccounts::toKopecks(amount));
+        if (recorder.isOpen()) {
+            recorder.command("topup").quoted(clientName).number(amount).end();
+        }
+    }
+
+    bool getPrepaidBalance(const string& clientName, double& balance) const {
+        const PrepaidAccounts::Account* account = prepaid.find(clientName);
+        if (!account) {
+            return false;
+        }
+        balance = account->balance.load(memory_order_acquire) / 100.0;
+        return true;
+    }
+
+    // Звонки хранятся в порядке возрастания номера, поэтому поиск двоичный
+    vector<Call>::iterator findCall(unsigned long long id) {
+        auto it = lower_bound(calls.begin(), calls.end(), id, [](const Call& call, unsigned long long key) {
+            return call.id < key;
+        });
+        if (it != calls.end() && it->id == id) {
+            return it;
+        }
+        return calls.end();
+    }
+
+    bool deleteCall(unsigned long long id) {
+        auto it = findCall(id);
+        if (it == calls.end()) {
+            return false;
+        }
+        size_t currency = static_cast<size_t>(it->currency);
+        totalRevenue[currency] -= it->price;
+        clientTotals[it->clientName][currency] -= it->price;
+        if (it->prepaid) {
+            if (PrepaidAccounts::Account* account = prepaid.find(it->clientName)) {
+                account->credit(it->chargedKopecks);
+            }
+        }
+        usage.record(it->clientName, it->cityName, -1, -it->duration);
+        if (recorder.isOpen()) {
+            recorder.command("delete").number(id).end();
+        }
+        calls.erase(it);
+        return true;
+    }
+
+    // Исправление длительности звонка с пересчётом стоимости по цене, действовавшей при регистрации
+    bool amendCall(unsigned long long id, double duration) {
+        auto it = findCall(id);
+        if (it == calls.end()) {
+            return false;
+        }
+        double newCost = duration * it->pricePerMinute;
+        double delta = newCost - it->price;
+        usage.record(it->clientName, it->cityName, 0, duration - it->duration);
+        it->duration = duration;
+        it->price = newCost;
+        size_t currency = static_cast<size_t>(it->currency);
+        totalRevenue[currency] += delta;
+        clientTotals[it->clientName][currency] += delta;
+        rechargePrepaid(*it);
+        if (recorder.isOpen()) {
+            recorder.command("amend").number(id).number(duration).end();
+        }
+        return true;
+    }
+
+    void setTariffPrice(int index, double price) {
+        if (index >= 0 && index < static_cast<int>(tariffs.size())) {
+            tariffs[index].price = price;
+            sortIndexValid = false;
+        }
+    }
+
+    // Перетарификация всех звонков на направление тарифа, начавшихся не раньше since, по текущей цене и валюте тарифа.
+    // Звонки делятся на части, каждая обрабатывается своим потоком со своими приращениями итогов,
+    // после чего приращения сливаются в общие суммы. Возвращает количество перетарифицированных звонков.
+    size_t rerateCalls(int tariffIndex, time_t since) {
+        if (tariffIndex < 0 || tariffIndex >= static_cast<int>(tariffs.size())) {
+            return 0;
+        }
+        const string& cityName = tariffs[tariffIndex].cityName;
+        const double newPrice = tariffs[tariffIndex].price;
+        const Currency newCurrency = tariffs[tariffIndex].currency;
+        if (recorder.isOpen()) {
+            recorder.command("reprice").quoted(cityName).number(newPrice).number(static_cast<long long>(since)).end();
+        }
+
+        struct Partial {
+            size_t rerated = 0;
+            CurrencyAmounts revenueDelta = {};
+            unordered_map<string, CurrencyAmounts> clientDeltas;
+            unordered_map<string, long long> prepaidDeltas;
+        };
+        const double newRubPerUnit = rates.getRate(newCurrency);
+
+        const size_t minChunk = 16384;
+        size_t workers = max<size_t>(1, min<size_t>(thread::hardware_concurrency(), calls.size() / minChunk));
+        size_t chunk = (calls.size() + workers - 1) / workers;
+        vector<Partial> partials(workers);
+
+        auto work = [&](size_t worker) {
+            Partial& partial = partials[worker];
+            size_t end = min(calls.size(), (worker + 1) * chunk);
+            for (size_t i = worker * chunk; i < end; ++i) {
+                Call& call = calls[i];
+                if (call.startTime < since || call.cityName != cityName) {
+                    continue;
+                }
+                double newCost = call.duration * newPrice;
+                CurrencyAmounts& clientDelta = partial.clientDeltas[call.clientName];
+                partial.revenueDelta[static_cast<size_t>(call.currency)] -= call.price;
+                clientDelta[static_cast<size_t>(call.currency)] -= call.price;
+                partial.revenueDelta[static_cast<size_t>(newCurrency)] += newCost;
+                clientDelta[static_cast<size_t>(newCurrency)] += newCost;
+                call.pricePerMinute = newPrice;
+                call.price = newCost;
+                call.currency = newCurrency;
+                if (call.prepaid) {
+                    long long charge = PrepaidAccounts::toKopecks(newCost * newRubPerUnit);
+                    partial.prepaidDeltas[call.clientName] += call.chargedKopecks - charge;
+                    call.chargedKopecks = charge;
+                }
+                ++partial.rerated;
+            }
+        };
+
+        vector<thread> threads;
+        for (size_t worker = 1; worker < workers; ++worker) {
+            threads.emplace_back(work, worker);
+        }
+        work(0);
+        for (auto& t : threads) {
+            t.join();
+        }
+
+        size_t rerated = 0;
+        for (const auto& partial : partials) {
+            rerated += partial.rerated;
+            for (size_t c = 0; c < currencyCount; ++c) {
+                totalRevenue[c] += partial.revenueDelta[c];
+            }
+            for (const auto& delta : partial.clientDeltas) {
+                CurrencyAmounts& clientTotal = clientTotals[delta.first];
+                for (size_t c = 0; c < currencyCount; ++c) {
+                    clientTotal[c] += delta.second[c];
+                }
+            }
+            for (const auto& refund : partial.prepaidDeltas) {
+                if (PrepaidAccounts::Account* account = prepaid.find(refund.first)) {
+                    account->credit(refund.second);
+                }
+            }
+        }
+        return rerated;
+    }
+
+    void printClientCalls(const string& clientName) const {
+        ReportWriter writer(ReportFormat::Text, {
+            { "id", "№", ": ", 0 },
+            { "city", "", ", ", 0 },
+            { "duration", "", " мин, стоимость: ", -1 },
+            { "cost", "", " ", moneyPrecision },
+            { "currency", "", "", 0 }
+        });
+        for (const auto& call : calls) {
+            if (call.clientName != clientName) {
+                continue;
+            }
+            writer.add(call.id);
+            writer.add(call.cityName);
+            writer.add(call.duration);
+            writer.add(call.price);
+            writer.add(currencyCode(call.currency));
+            writer.endRow();
+        }
+        if (writer.getRows() == 0) {
+            writer.text("У клиента нет звонков.\n");
+        }
+        writer.flush(cout);
+    }
+
+    // Выгрузка всех звонков (из архива и из памяти). Возвращает количество выгруженных звонков.
+    size_t exportCalls(ostream& out, ReportFormat format) const {
+        const size_t flushSize = 8 << 20;
+        ReportWriter writer(format, {
+            { "id", "№", ": ", 0 },
+            { "client", "", " -> ", 0 },
+            { "city", "", ", начало ", 0 },
+            { "start_time", "", ", ", 0 },
+            { "duration", "", " мин, стоимость: ", -1 },
+            { "cost", "", " ", moneyPrecision },
+            { "currency", "", "", 0 }
+        });
+        for (size_t block = 0; block < archive.getBlockCount(); ++block) {
+            archive.forEachInBlock(block, [&](const CallArchive::ArchivedCall& call) {
+                writer.add(call.id);
+                writer.add(archive.getName(call.client));
+                writer.add(archive.getName(call.city));
+                writer.add(static_cast<unsigned long long>(call.startTime));
+                writer.add(call.duration);
+                writer.add(call.price);
+                writer.add(currencyCode(call.currency));
+                writer.endRow();
+                writer.flushIfLarger(out, flushSize);
+            });
+        }
+        for (const auto& call : calls) {
+            writer.add(call.id);
+            writer.add(call.clientName);
+            writer.add(call.cityName);
+            writer.add(static_cast<unsigned long long>(call.startTime));
+            writer.add(call.duration);
+            writer.add(call.price);
+            writer.add(currencyCode(call.currency));
+            writer.endRow();
+            writer.flushIfLarger(out, flushSize);
+        }
+        size_t exported = writer.getRows();
+        writer.flush(out);
+        return exported;
+    }
+
+    // Резервирует место под звонки заранее, чтобы вектор не перевыделялся при массовой загрузке
+    void reserveCalls(size_t count) {
+        calls.reserve(calls.size() + count);
+    }
+
+    size_t getCallsCount() const {
+        return calls.size() + archive.getCallsCount();
+    }
+
+    const CallArchive& getArchive() const {
+        return archive;
+    }
+
+    const UsageMatrix& getUsage() const {
+        return usage;
+    }
+
+    // Восстановление начинается с пустой АТС, поэтому журнал, начатый после первых изменений,
+    // не воспроизвести: тарифов, курсов и звонков, заведённых до него, в нём нет
+    bool canStartRecording() const {
+        const ExchangeRates defaults;
+        for (size_t i = 0; i < currencyCount; i++) {
+            if (rates.getRate(static_cast<Currency>(i)) != defaults.getRate(static_cast<Currency>(i))) {
+                return false;
+            }
+        }
+#ifndef _WIN32
+        // Общих тарифов в журнале нет, звонки по ним при восстановлении не найдут тарифа
+        if (sharedTariffs) {
+            return false;
+        }
+#endif
+        return tariffs.empty() && calls.empty() && archive.getCallsCount() == 0 &&
+            clientTotals.empty() && prepaid.empty();
+    }
+
+    bool startRecording(const string& fileName) {
+        return canStartRecording() && recorder.open(fileName);
+    }
+
+    // Завершение журнала строкой verify с контрольной суммой итогов, по которой сверяется восстановление
+    void stopRecording() {
+        if (!recorder.isOpen()) {
+            return;
+        }
+        recorder.command("verify").number(static_cast<unsigned long long>(getTotalsChecksum())).end();
+        recorder.close();
+    }
+
+    bool isRecording() const {
+        return recorder.isOpen();
+    }
+
+    // Номер, под которым будет зарегистрирован следующий звонок; номера только растут,
+    // иначе поиск звонка двоичным поиском перестанет работать
+    bool setNextCallId(unsigned long long id) {
+        if (id < nextCallId) {
+            return false;
+        }
+        nextCallId = id;
+        return true;
+    }
+
+    // Контрольная сумма итогов (FNV-1a): число звонков, общая выручка и суммы клиентов по валютам
+    // в копейках. Клиенты берутся по возрастанию имени, поэтому сумма не зависит от порядка звонков,
+    // а округление до копеек - от порядка сложения.
+    uint64_t getTotalsChecksum() const {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](const void* data, size_t size) {
+            const unsigned char* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            }
+        };
+        auto mixAmounts = [&mix](const CurrencyAmounts& amounts) {
+            for (double amount : amounts) {
+                long long kopecks = llround(amount * 100);
+                mix(&kopecks, sizeof(kopecks));
+            }
+        };
+
+        unsigned long long callCount = getCallsCount();
+        mix(&callCount, sizeof(callCount));
+        mixAmounts(totalRevenue);
+        vector<const pair<const string, CurrencyAmounts>*> clients;
+        clients.reserve(clientTotals.size());
+        for (const auto& client : clientTotals) {
+            clients.push_back(&client);
+        }
+        sort(clients.begin(), clients.end(), [](const auto* a, const auto* b) {
+            return a->first < b->first;
+        });
+        for (const auto* client : clients) {
+            mix(client->first.data(), client->first.size() + 1);
+            mixAmounts(client->second);
+        }
+        return hash;
+    }
+
+    // Сборка пустой АТС из частей, построенных по непересекающимся наборам клиентов (параллельное
+    // восстановление из журнала). Тарифы и курсы во всех частях одинаковые и берутся из первой,
+    // звонки сливаются по номеру. Итоги клиентов и счета переносятся без сложения, поэтому в АТС
+    // не должно быть ни звонков, ни клиентов: иначе слияние отказывается и возвращает false.
+    // Части после слияния больше не нужны.
+    bool mergePartitions(vector<unique_ptr<ATC>>& parts) {
+        if (!calls.empty() || archive.getCallsCount() != 0 || !clientTotals.empty() || !prepaid.empty()) {
+            return false;
+        }
+        if (parts.empty()) {
+            return true;
+        }
+        tariffs = parts[0]->tariffs;
+        tariffByCity = parts[0]->tariffByCity;
+        rates = parts[0]->rates;
+        sortIndexValid = false;
+
+        size_t total = calls.size();
+        for (const auto& part : parts) {
+            total += part->calls.size();
+        }
+        calls.reserve(total);
+        // Слияние k упорядоченных по номеру последовательностей; k - число потоков, поэтому хватает линейного выбора
+        vector<size_t> positions(parts.size(), 0);
+        while (true) {
+            size_t best = parts.size();
+            for (size_t i = 0; i < parts.size(); ++i) {
+                if (positions[i] < parts[i]->calls.size()
+                    && (best == parts.size() || parts[i]->calls[positions[i]].id < parts[best]->calls[positions[best]].id)) {
+                    best = i;
+                }
+            }
+            if (best == parts.size()) {
+                break;
+            }
+            calls.push_back(move(parts[best]->calls[positions[best]++]));
+        }
+
+        for (auto& part : parts) {
+            nextCallId = max(nextCallId, part->nextCallId);
+            for (size_t c = 0; c < currencyCount; ++c) {
+                totalRevenue[c] += part->totalRevenue[c];
+            }
+            clientTotals.merge(part->clientTotals);
+            fraudDetector.merge(part->fraudDetector);
+            fraudAlerts.insert(fraudAlerts.end(), part->fraudAlerts.begin(), part->fraudAlerts.end());
+            prepaid.merge(part->prepaid);
+            usage.merge(part->usage);
+        }
+        sort(fraudAlerts.begin(), fraudAlerts.end(), [](const FraudAlert& a, const FraudAlert& b) {
+            return a.callId < b.callId;
+        });
+        return true;
+    }
+
+    const vector<Call>& getCalls() const {
+        return calls;
+    }
+
+    bool isArchivedSince(time_t since) const {
+        return archive.getCallsCount() > 0 && archive.getMaxTime() >= since;
+    }
+
+    // Перенос звонков, начавшихся раньше cutoff, в сжатый архив. Архив хранит длительность и цену
+    // минуты без округления, поэтому выгрузка и выручка за период после переноса не меняются.
+    size_t archiveCallsBefore(time_t cutoff) {
+        // Архивные звонки не перетарифицируются, поэтому момент архивации нужен журналу
+        if (recorder.isOpen()) {
+            recorder.command("archive").number(static_cast<long long>(cutoff)).end();
+        }
+        vector<const Call*> archived;
+        for (const auto& call : calls) {
+            if (call.startTime < cutoff) {
+                archived.push_back(&call);
+            }
+        }
+        if (archived.empty()) {
+            return 0;
+        }
+        archive.append(archived);
+
+        calls.erase(remove_if(calls.begin(), calls.end(), [cutoff](const Call& call) {
+            return call.startTime < cutoff;
+        }), calls.end());
+        calls.shrink_to_fit();
+        return archived.size();
+    }
+
+    // Выручка за звонки, начавшиеся в период [from, to], включая архив, в валюте target
+    double getRevenueForPeriod(time_t from, time_t to, Currency target = Currency::RUB) const {
+        CurrencyAmounts revenue = archive.getRevenue(from, to);
+        for (const auto& call : calls) {
+            if (call.startTime >= from && call.startTime <= to) {
+                revenue[static_cast<size_t>(call.currency)] += call.price;
+            }
+        }
+        return rates.convert(revenue, target);
+    }
+
+
+    double getTotalRevenue(Currency target = Currency::RUB) const {
+        return rates.convert(totalRevenue, target);
+    }
+
+    double getClientTotalCallsCost(const string& clientName, Currency target = Currency::RUB) const {
+        auto it = clientTotals.find(clientName);
+        return it != clientTotals.end() ? rates.convert(it->second, target) : 0.0;
+    }
+};
+
+
+enum class GroupBy {
+    Client,
+    City,
+    Hour
+};
+
+// Отчёт по звонкам с группировкой: количество, сумма, средняя, минимальная и максимальная стоимость.
+// Звонки из памяти и блоки архива делятся на задачи; потоки забирают задачи из общего счётчика,
+// агрегируют их в собственную хеш-таблицу, после чего таблицы сливаются в одну.
+// Суммы копятся по валютам и пересчитываются в валюту отчёта только для итоговых групп.
+class CallAnalytics {
+public:
+    struct GroupRow {
+        string key;
+        size_t count = 0;
+        double sum = 0;
+        double minCost = numeric_limits<double>::max();
+        double maxCost = numeric_limits<double>::lowest();
+    };
+
+private:
+    struct Aggregate {
+        size_t count = 0;
+        CurrencyAmounts sum = {};
+        CurrencyAmounts minCost = { numeric_limits<double>::max(), numeric_limits<double>::max(), numeric_limits<double>::max() };
+        CurrencyAmounts maxCost = { numeric_limits<double>::lowest(), numeric_limits<double>::lowest(), numeric_limits<double>::lowest() };
+
+        void add(double cost, Currency currency) {
+            size_t c = static_cast<size_t>(currency);
+            ++count;
+            sum[c] += cost;
+            minCost[c] = min(minCost[c], cost);
+            maxCost[c] = max(maxCost[c], cost);
+        }
+
+        void merge(const Aggregate& other) {
+            count += other.count;
+            for (size_t c = 0; c < currencyCount; ++c) {
+                sum[c] += other.sum[c];
+                minCost[c] = min(minCost[c], other.minCost[c]);
+                maxCost[c] = max(maxCost[c], other.maxCost[c]);
+            }
+        }
+    };
+
+    static constexpr size_t chunkSize = 65536;
+
+    // Смещение местного времени от UTC, чтобы не вызывать localtime из потоков
+    static long long localOffset() {
+        time_t now = time(nullptr);
+        tm utc = *gmtime(&now);
+        utc.tm_isdst = -1;
+        return static_cast<long long>(difftime(now, mktime(&utc)));
+    }
+
+    static string hourKey(time_t startTime, long long offset) {
+        long long seconds = ((static_cast<long long>(startTime) + offset) % 86400 + 86400) % 86400;
+        long long hour = seconds / 3600;
+        string key = hour < 10 ? "0" : "";
+        key += to_string(hour);
+        key += ":00";
+        return key;
+    }
+
+public:
+    static vector<GroupRow> run(const ATC& atc, GroupBy groupBy, time_t from, time_t to, Currency target = Currency::RUB) {
+        const vector<Call>& calls = atc.getCalls();
+        const CallArchive& archive = atc.getArchive();
+        const long long offset = localOffset();
+
+        const size_t hotTasks = (calls.size() + chunkSize - 1) / chunkSize;
+        const size_t taskCount = hotTasks + archive.getBlockCount();
+        const size_t workers = max<size_t>(1, min<size_t>(thread::hardware_concurrency(), taskCount));
+        vector<unordered_map<string, Aggregate>> partials(workers);
+        atomic<size_t> nextTask(0);
+
+        auto work = [&](size_t worker) {
+            unordered_map<string, Aggregate>& groups = partials[worker];
+            for (size_t task = nextTask++; task < taskCount; task = nextTask++) {
+                if (task < hotTasks) {
+                    size_t end = min(calls.size(), (task + 1) * chunkSize);
+                    for (size_t i = task * chunkSize; i < end; ++i) {
+                        const Call& call = calls[i];
+                        if (call.startTime < from || call.startTime > to) {
+                            continue;
+                        }
+                        switch (groupBy) {
+                        case GroupBy::Client:
+                            groups[call.clientName].add(call.price, call.currency);
+                            break;
+                        case GroupBy::City:
+                            groups[call.cityName].add(call.price, call.currency);
+                            break;
+                        case GroupBy::Hour:
+                            groups[hourKey(call.startTime, offset)].add(call.price, call.currency);
+                            break;
+                        }
+                    }
+                    continue;
+                }
+
+                size_t block = task - hotTasks;
+                if (!archive.blockOverlaps(block, from, to)) {
+                    continue;
+                }
+                archive.forEachInBlock(block, [&](const CallArchive::ArchivedCall& call) {
+                    if (call.startTime < from || call.startTime > to) {
+                        return;
+                    }
+                    switch (groupBy) {
+                    case GroupBy::Client:
+                        groups[archive.getName(call.client)].add(call.price, call.currency);
+                        break;
+                    case GroupBy::City:
+                        groups[archive.getName(call.city)].add(call.price, call.currency);
+                        break;
+                    case GroupBy::Hour:
+                        groups[hourKey(call.startTime, offset)].add(call.price, call.currency);
+                        break;
+                    }
+                });
+            }
+        };
+
+        vector<thread> threads;
+        for (size_t worker = 1; worker < workers; ++worker) {
+            threads.emplace_back(work, worker);
+        }
+        work(0);
+        for (auto& t : threads) {
+            t.join();
+        }
+
+        unordered_map<string, Aggregate> merged = move(partials[0]);
+        for (size_t worker = 1; worker < workers; ++worker) {
+            for (const auto& group : partials[worker]) {
+                merged[group.first].merge(group.second);
+            }
+        }
+
+        const ExchangeRates& rates = atc.getRates();
+        vector<GroupRow> rows;
+        rows.reserve(merged.size());
+        for (const auto& group : merged) {
+            GroupRow row;
+            row.key = group.first;
+            row.count = group.second.count;
+            row.sum = rates.convert(group.second.sum, target);
+            for (size_t c = 0; c < currencyCount; ++c) {
+                if (group.second.sum[c] == 0 && group.second.minCost[c] > group.second.maxCost[c]) {
+                    continue;
+                }
+                row.minCost = min(row.minCost, rates.convert(group.second.minCost[c], static_cast<Currency>(c), target));
+                row.maxCost = max(row.maxCost, rates.convert(group.second.maxCost[c], static_cast<Currency>(c), target));
+            }
+            rows.push_back(row);
+        }
+        if (groupBy == GroupBy::Hour) {
+            sort(rows.begin(), rows.end(), [](const GroupRow& a, const GroupRow& b) {
+                return a.key < b.key;
+            });
+        }
+        else {
+            sort(rows.begin(), rows.end(), [](const GroupRow& a, const GroupRow& b) {
+                return a.sum > b.sum;
+            });
+        }
+        return rows;
+    }
+
+    static void print(const vector<GroupRow>& rows, size_t limit) {
+        ReportWriter writer(ReportFormat::Text, {
+            { "group", "", " | ", 0 },
+            { "count", "", " | ", 0 },
+            { "sum", "", " | ", moneyPrecision },
+            { "avg", "", " | ", moneyPrecision },
+            { "min", "", " | ", moneyPrecision },
+            { "max", "", "", moneyPrecision }
+        });
+        if (rows.empty()) {
+            writer.text("Звонков за период нет.\n");
+        }
+        else {
+            writer.text("Группа | Звонков | Сумма | Средняя | Мин | Макс\n");
+        }
+        for (size_t i = 0; i < rows.size() && i < limit; ++i) {
+            const GroupRow& row = rows[i];
+            writer.add(row.key);
+            writer.add(static_cast<unsigned long long>(row.count));
+            writer.add(row.sum);
+            writer.add(row.sum / row.count);
+            writer.add(row.minCost);
+            writer.add(row.maxCost);
+            writer.endRow();
+        }
+        if (rows.size() > limit) {
+            writer.text("... и ещё групп: ").number(static_cast<unsigned long long>(rows.size() - limit)).text("\n");
+        }
+        writer.flush(cout);
+    }
+};
+
+// Реестр независимых АТС (арендаторов). У каждой АТС свои тарифы, звонки и итоги.
+class ATCRegistry {
+private:
+    map<string, unique_ptr<ATC>> tenants;
+
+public:
+    ATC& getOrCreate(const string& tenantName) {
+        auto& tenant = tenants[tenantName];
+        if (!tenant) {
+            tenant = make_unique<ATC>(tenantName);
+        }
+        return *tenant;
+    }
+
+    bool remove(const string& tenantName) {
+        return tenants.erase(tenantName) > 0;
+    }
+
+    void printTenants() const {
+        cout << "Список АТС:\n";
+        for (const auto& tenant : tenants) {
+            cout << tenant.first << ": тарифов " << tenant.second->getTariffs().size()
+                << ", звонков " << tenant.second->getCallsCount()
+                << ", выручка " << tenant.second->getTotalRevenue() << "\n";
+        }
+    }
+};
+
+// Генератор синтетической нагрузки: воспроизводимый по seed поток звонков.
+// Клиенты и направления выбираются по закону Ципфа, время начала звонка - по суточной
+// кривой нагрузки, длительность - по логнормальному распределению.
+class LoadGenerator {
+public:
+    enum class OutputFormat {
+        Csv,
+        Binary
+    };
+
+    struct GeneratedCall {
+        uint32_t client;
+        uint32_t city;
+        time_t startTime;
+        double duration;
+    };
+
+private:
+    static constexpr time_t baseTime = 1704067200; // 01.01.2024 00:00 UTC
+    static constexpr int days = 30;
+
+    mt19937_64 rng;
+    vector<string> clients;
+    vector<string> cities;
+    vector<double> prices;
+    discrete_distribution<uint32_t> clientDist;
+    discrete_distribution<uint32_t> cityDist;
+    discrete_distribution<int> hourDist;
+    uniform_int_distribution<int> dayDist;
+    uniform_int_distribution<int> secondDist;
+    lognormal_distribution<double> durationDist;
+
+    static vector<double> zipfWeights(size_t count, double exponent) {
+        vector<double> weights(count);
+        for (size_t i = 0; i < count; ++i) {
+            weights[i] = 1.0 / pow(static_cast<double>(i + 1), exponent);
+        }
+        return weights;
+    }
+
+    static vector<string> makeClientNames(size_t count) {
+        static const char* firstNames[] = {
+            "Иван", "Пётр", "Сергей", "Алексей", "Дмитрий", "Андрей", "Михаил", "Николай",
+            "Анна", "Мария", "Елена", "Ольга", "Наталья", "Татьяна", "Ирина", "Светлана"
+        };
+        static const char* lastNames[] = {
+            "Иванов", "Петров", "Смирнов", "Кузнецов", "Попов", "Васильев", "Соколов", "Михайлов",
+            "Новиков", "Фёдоров", "Морозов", "Волков", "Алексеев", "Лебедев", "Семёнов", "Егоров"
+        };
+        const size_t firstCount = sizeof(firstNames) / sizeof(firstNames[0]);
+        const size_t lastCount = sizeof(lastNames) / sizeof(lastNames[0]);
+
+        vector<string> names;
+        names.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            string name = string(firstNames[i % firstCount]) + " " + lastNames[(i / firstCount) % lastCount];
+            size_t round = i / (firstCount * lastCount);
+            if (round > 0) {
+                name += " " + to_string(round + 1);
+            }
+            names.push_back(name);
+        }
+        return names;
+    }
+
+    static vector<string> makeCityNames(size_t count) {
+        static const char* cityNames[] = {
+            "Москва", "Санкт-Петербург", "Новосибирск", "Екатеринбург", "Казань", "Нижний Новгород",
+            "Челябинск", "Самара", "Омск", "Ростов-на-Дону", "Уфа", "Красноярск", "Воронеж", "Пермь",
+            "Волгоград", "Краснодар", "Саратов", "Тюмень", "Тольятти", "Ижевск", "Барнаул", "Иркутск",
+            "Хабаровск", "Ярославль", "Владивосток", "Томск", "Оренбург", "Кемерово", "Рязань", "Астрахань"
+        };
+        const size_t cityCount = sizeof(cityNames) / sizeof(cityNames[0]);
+
+        vector<string> names;
+        names.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            string name = cityNames[i % cityCount];
+            if (i >= cityCount) {
+                name += "-" + to_string(i / cityCount + 1);
+            }
+            names.push_back(name);
+        }
+        return names;
+    }
+
+    // Относительная нагрузка по часам суток: ночной спад, пики утром и вечером
+    static vector<double> diurnalWeights() {
+        return { 2, 1, 1, 1, 1, 2, 4, 7, 10, 12, 13, 12, 11, 11, 12, 12, 11, 12, 13, 12, 10, 8, 5, 3 };
+    }
+
+    static void appendNumber(string& out, double value) {
+        char buffer[32];
+        auto result = to_chars(buffer, buffer + sizeof(buffer), value, chars_format::fixed, 2);
+        out.append(buffer, result.ptr);
+    }
+
+    static void appendNumber(string& out, long long value) {
+        char buffer[24];
+        auto result = to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+    }
+
+public:
+    LoadGenerator(uint64_t seed, size_t clientCount, size_t cityCount)
+        : rng(seed),
+          clients(makeClientNames(clientCount)),
+          cities(makeCityNames(cityCount)),
+          dayDist(0, days - 1),
+          secondDist(0, 3599),
+          durationDist(1.0, 0.8) {
+        vector<double> clientWeights = zipfWeights(clientCount, 1.1);
+        vector<double> cityWeights = zipfWeights(cityCount, 1.3);
+        vector<double> hourWeights = diurnalWeights();
+        clientDist = discrete_distribution<uint32_t>(clientWeights.begin(), clientWeights.end());
+        cityDist = discrete_distribution<uint32_t>(cityWeights.begin(), cityWeights.end());
+        hourDist = discrete_distribution<int>(hourWeights.begin(), hourWeights.end());
+
+        // Цены направлений тоже зависят только от seed
+        uniform_int_distribution<int> priceDist(1, 30);
+        prices.reserve(cityCount);
+        for (size_t i = 0; i < cityCount; ++i) {
+            prices.push_back(priceDist(rng));
+        }
+    }
+
+    GeneratedCall next() {
+        GeneratedCall call;
+        call.client = clientDist(rng);
+        call.city = cityDist(rng);
+        call.startTime = baseTime + static_cast<time_t>(dayDist(rng)) * 86400
+            + static_cast<time_t>(hourDist(rng)) * 3600 + secondDist(rng);
+        call.duration = round(durationDist(rng) * 100) / 100;
+        return call;
+    }
+
+    const string& getClientName(uint32_t client) const {
+        return clients[client];
+    }
+
+    const string& getCityName(uint32_t city) const {
+        return cities[city];
+    }
+
+    // Тарифы для направлений генератора, которых ещё нет в АТС
+    void addTariffs(ATC& atc) const {
+        for (size_t i = 0; i < cities.size(); ++i) {
+            if (atc.findTariff(cities[i]) < 0) {
+                atc.addTariff(cities[i], prices[i]);
+            }
+        }
+    }
+
+    // Прогон звонков напрямую через API АТС (без ввода с клавиатуры)
+    void run(ATC& atc, size_t count) {
+        addTariffs(atc);
+        // Звонки оцениваются по действующему тарифу направления (своему или из общей таблицы),
+        // даже если он задан до генератора; направления без тарифа пропускаются
+        vector<Tariff> rates;
+        vector<bool> hasRate(cities.size());
+        rates.reserve(cities.size());
+        for (size_t i = 0; i < cities.size(); ++i) {
+            rates.emplace_back(cities[i], 0.0, Currency::RUB);
+            hasRate[i] = atc.findRate(cities[i], rates[i].price, rates[i].currency);
+        }
+        atc.reserveCalls(count);
+        for (size_t i = 0; i < count; ++i) {
+            GeneratedCall call = next();
+            if (hasRate[call.city]) {
+                const Tariff& rate = rates[call.city];
+                atc.rateCall(clients[call.client], cities[call.city], call.duration, rate.price, call.startTime, rate.currency);
+            }
+        }
+    }
+
+    // Запись звонков в файл. Данные собираются в буфер и сбрасываются крупными блоками.
+    void write(ostream& out, size_t count, OutputFormat format) {
+        const size_t flushSize = 1 << 20;
+        string buffer;
+        buffer.reserve(flushSize + 256);
+
+        if (format == OutputFormat::Csv) {
+            buffer += "client,city,start_time,duration,price_per_minute,cost\n";
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            GeneratedCall call = next();
+            if (format == OutputFormat::Csv) {
+                buffer += clients[call.client];
+                buffer += ',';
+                buffer += cities[call.city];
+                buffer += ',';
+                appendNumber(buffer, static_cast<long long>(call.startTime));
+                buffer += ',';
+                appendNumber(buffer, call.duration);
+                buffer += ',';
+                appendNumber(buffer, prices[call.city]);
+                buffer += ',';
+                appendNumber(buffer, call.duration * prices[call.city]);
+                buffer += '\n';
+            }
+            else {
+                int64_t start = call.startTime;
+                buffer.append(reinterpret_cast<const char*>(&call.client), sizeof(call.client));
+                buffer.append(reinterpret_cast<const char*>(&call.city), sizeof(call.city));
+                buffer.append(reinterpret_cast<const char*>(&start), sizeof(start));
+                buffer.append(reinterpret_cast<const char*>(&call.duration), sizeof(call.duration));
+            }
+
+            if (buffer.size() >= flushSize) {
+                out.write(buffer.data(), buffer.size());
+                buffer.clear();
+            }
+        }
+        out.write(buffer.data(), buffer.size());
+    }
+};
+
+// Ограниченная кольцевая очередь без блокировок для нескольких производителей и потребителей
+// (схема Д. Вьюкова). У каждой ячейки свой счётчик: производитель занимает ячейку, когда счётчик
+// равен позиции записи, потребитель - когда он на единицу больше позиции чтения. С одним
+// потребителем это та же очередь MPSC. Ёмкость округляется вверх до степени двойки.
+template <typename T>
+class RingQueue {
+private:
+    struct Cell {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    size_t capacity;
+    size_t mask;
+    unique_ptr<Cell[]> cells;
+    // Позиции записи и чтения на разных строках кэша, чтобы производители не мешали потребителям
+    alignas(64) atomic<size_t> tail{ 0 };
+    alignas(64) atomic<size_t> head{ 0 };
+
+    // Вызывающий ограничивает ёмкость сам; здесь только не даём сдвигу переполниться до нуля
+    static size_t roundCapacity(size_t minCapacity) {
+        size_t result = 2;
+        while (result < minCapacity && result <= numeric_limits<size_t>::max() / 2) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+public:
+    explicit RingQueue(size_t minCapacity)
+        : capacity(roundCapacity(minCapacity)), mask(capacity - 1), cells(new Cell[capacity]) {
+        for (size_t i = 0; i < capacity; ++i) {
+            cells[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+
+    size_t getCapacity() const {
+        return capacity;
+    }
+
+    // Приблизительное число элементов: позиции читаются не одновременно
+    size_t size() const {
+        size_t read = head.load(memory_order_acquire);
+        size_t written = tail.load(memory_order_acquire);
+        return written > read ? written - read : 0;
+    }
+
+    // Значение перемещается в очередь только при успехе; false - очередь заполнена
+    bool tryPush(T& value) {
+        size_t pos = tail.load(memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (difference == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    cell.value = move(value);
+                    cell.sequence.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0) {
+                return false;
+            }
+            else {
+                pos = tail.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // Забирает подряд до maxCount готовых элементов одним сдвигом позиции чтения
+    size_t tryPopBatch(T* out, size_t maxCount) {
+        size_t pos = head.load(memory_order_relaxed);
+        while (true) {
+            size_t ready = 0;
+            while (ready < maxCount && cells[(pos + ready) & mask].sequence.load(memory_order_acquire) == pos + ready + 1) {
+                ++ready;
+            }
+            if (ready == 0) {
+                size_t current = head.load(memory_order_relaxed);
+                if (current == pos) {
+                    return 0;
+                }
+                pos = current;
+                continue;
+            }
+            // Ячейки [pos, pos + ready) заполнены; захватить их может только тот, кто сдвинет head
+            if (head.compare_exchange_weak(pos, pos + ready, memory_order_relaxed)) {
+                for (size_t i = 0; i < ready; ++i) {
+                    Cell& cell = cells[(pos + i) & mask];
+                    out[i] = move(cell.value);
+                    cell.sequence.store(pos + i + capacity, memory_order_release);
+                }
+                return ready;
+            }
+        }
+    }
+};
+
+// Приём звонков с буфером между источниками записей и тарификацией. Источники (отдельные потоки)
+// кладут сырые записи в кольцевую очередь, а тарификатор в вызывающем потоке забирает их пачками:
+// АТС не потокобезопасна, поэтому потребитель один. Когда очередь заполнена, источник ждёт (Block),
+// отбрасывает запись (Drop) или сбрасывает её в файл (Spill); сброшенные записи тарифицируются
+// после того, как источники закончат и очередь опустеет.
+class IngestPipeline {
+public:
+    enum class BackPressure {
+        Block,
+        Drop,
+        Spill
+    };
+
+    struct RawCall {
+        string clientName;
+        string cityName;
+        double duration = 0;
+        time_t startTime = 0;
+        chrono::steady_clock::time_point enqueuedAt;
+    };
+
+    struct Metrics {
+        size_t produced = 0;
+        size_t enqueued = 0;
+        size_t waits = 0; // сколько раз источник ждал места в очереди
+        size_t dropped = 0;
+        size_t spilled = 0;
+        size_t rated = 0;
+        size_t rejected = 0;
+        size_t recovered = 0; // протарифицировано из файла сброса
+        size_t batches = 0;
+        size_t capacity = 0;
+        size_t maxDepth = 0;
+        double averageDepth = 0;
+        double averageLatency = 0; // секунды от постановки в очередь до тарификации
+        double maxLatency = 0;
+        double seconds = 0;
+    };
+
+    static constexpr size_t batchSize = 256;
+    // Наибольшая ёмкость очереди: около ста мегабайт ячеек
+    static constexpr size_t maxCapacity = 1 << 20;
+
+    static bool parseBackPressure(string_view text, BackPressure& policy) {
+        if (text == "block") {
+            policy = BackPressure::Block;
+        }
+        else if (text == "drop") {
+            policy = BackPressure::Drop;
+        }
+        else if (text == "spill") {
+            policy = BackPressure::Spill;
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr size_t spillFlushSize = 1 << 16;
+
+    // Счётчики источника; у каждого своя строка кэша, итоги складываются после завершения
+    struct alignas(64) ProducerStats {
+        size_t produced = 0;
+        size_t enqueued = 0;
+        size_t waits = 0;
+        size_t dropped = 0;
+        size_t spilled = 0;
+    };
+
+    ATC& atc;
+    RingQueue<RawCall> queue;
+    BackPressure policy;
+    string spillFileName;
+    ofstream spillFile;
+    mutex spillMutex;
+
+    // Запись сброса: длина и байты имени клиента, то же для направления, длительность, начало
+    static void appendSpill(string& out, const RawCall& call) {
+        uint32_t clientLength = static_cast<uint32_t>(call.clientName.size());
+        uint32_t cityLength = static_cast<uint32_t>(call.cityName.size());
+        int64_t start = call.startTime;
+        out.append(reinterpret_cast<const char*>(&clientLength), sizeof(clientLength));
+        out.append(call.clientName);
+        out.append(reinterpret_cast<const char*>(&cityLength), sizeof(cityLength));
+        out.append(call.cityName);
+        out.append(reinterpret_cast<const char*>(&call.duration), sizeof(call.duration));
+        out.append(reinterpret_cast<const char*>(&start), sizeof(start));
+    }
+
+    // Источники копят сброшенные записи у себя и пишут в общий файл крупными блоками
+    void flushSpill(string& buffer) {
+        if (buffer.empty()) {
+            return;
+        }
+        lock_guard<mutex> lock(spillMutex);
+        spillFile.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+        buffer.clear();
+    }
+
+    // Цена направления ищется через findRate, поэтому при подключённой общей таблице
+    // тарификатор видит её новые версии между пачками
+    struct Rate {
+        bool found = false;
+        double price = 0;
+        Currency currency = Currency::RUB;
+    };
+
+    bool rate(const RawCall& call, const Rate& rate) {
+        return rate.found && atc.rateCall(call.clientName, call.cityName, call.duration, rate.price, call.startTime, rate.currency);
+    }
+
+    // Дозагрузка сброшенных записей, когда поток звонков уже обработан
+    void recoverSpill(Metrics& metrics) {
+        spillFile.close();
+        ifstream in(spillFileName, ios::binary);
+        string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        RawCall call;
+        size_t pos = 0;
+        auto readBytes = [&](void* target, size_t size) {
+            if (data.size() - pos < size) {
+                return false;
+            }
+            memcpy(target, data.data() + pos, size);
+            pos += size;
+            return true;
+        };
+        auto readName = [&](string& name) {
+            uint32_t length;
+            if (!readBytes(&length, sizeof(length)) || data.size() - pos < length) {
+                return false;
+            }
+            name.assign(data, pos, length);
+            pos += length;
+            return true;
+        };
+        int64_t start;
+        while (readName(call.clientName) && readName(call.cityName)
+            && readBytes(&call.duration, sizeof(call.duration)) && readBytes(&start, sizeof(start))) {
+            call.startTime = static_cast<time_t>(start);
+            Rate cityRate;
+            cityRate.found = atc.findRate(call.cityName, cityRate.price, cityRate.currency);
+            if (rate(call, cityRate)) {
+                ++metrics.recovered;
+            }
+            else {
+                ++metrics.rejected;
+            }
+        }
+    }
+
+public:
+    IngestPipeline(ATC& atc, size_t capacity, BackPressure policy, const string& spillFileName = "")
+        : atc(atc), queue(capacity), policy(policy), spillFileName(spillFileName) {
+    }
+
+    // Прогон нагрузки: каждый источник генерирует свою долю звонков (seed = номер источника + 1).
+    // false - не удалось открыть файл сброса.
+    bool run(size_t producerCount, size_t callCount, size_t clientCount, size_t cityCount, Metrics& metrics) {
+        metrics = Metrics();
+        metrics.capacity = queue.getCapacity();
+        if (policy == BackPressure::Spill) {
+            spillFile.open(spillFileName, ios::binary | ios::trunc);
+            if (!spillFile) {
+                return false;
+            }
+        }
+
+        vector<unique_ptr<LoadGenerator>> generators;
+        for (size_t i = 0; i < producerCount; ++i) {
+            generators.push_back(make_unique<LoadGenerator>(i + 1, clientCount, cityCount));
+        }
+        generators.front()->addTariffs(atc);
+        atc.reserveCalls(callCount);
+
+        auto start = chrono::steady_clock::now();
+        vector<ProducerStats> producerStats(producerCount);
+        atomic<size_t> finishedProducers{ 0 };
+        auto produce = [&](size_t producer) {
+            LoadGenerator& generator = *generators[producer];
+            ProducerStats& stats = producerStats[producer];
+            size_t count = callCount / producerCount + (producer < callCount % producerCount ? 1 : 0);
+            string spillBuffer;
+            RawCall call;
+            for (size_t i = 0; i < count; ++i) {
+                LoadGenerator::GeneratedCall generated = generator.next();
+                call.clientName = generator.getClientName(generated.client);
+                call.cityName = generator.getCityName(generated.city);
+                call.duration = generated.duration;
+                call.startTime = generated.startTime;
+                call.enqueuedAt = chrono::steady_clock::now();
+                ++stats.produced;
+                if (queue.tryPush(call)) {
+                    ++stats.enqueued;
+                    continue;
+                }
+                switch (policy) {
+                case BackPressure::Block:
+                    ++stats.waits;
+                    do {
+                        this_thread::yield();
+                    } while (!queue.tryPush(call));
+                    ++stats.enqueued;
+                    break;
+                case BackPressure::Drop:
+                    ++stats.dropped;
+                    break;
+                case BackPressure::Spill:
+                    appendSpill(spillBuffer, call);
+                    ++stats.spilled;
+                    if (spillBuffer.size() >= spillFlushSize) {
+                        flushSpill(spillBuffer);
+                    }
+                    break;
+                }
+            }
+            flushSpill(spillBuffer);
+            finishedProducers.fetch_add(1, memory_order_release);
+        };
+        vector<thread> producers;
+        for (size_t i = 0; i < producerCount; ++i) {
+            producers.emplace_back(produce, i);
+        }
+
+        // Одна отметка времени, один замер глубины и один сдвиг позиции чтения на пачку;
+        // тариф ищется заново только при смене направления внутри пачки
+        vector<RawCall> batch(batchSize);
+        double latencySum = 0;
+        double depthSum = 0;
+        while (true) {
+            size_t depth = queue.size();
+            size_t count = queue.tryPopBatch(batch.data(), batchSize);
+            if (count == 0) {
+                if (finishedProducers.load(memory_order_acquire) < producerCount) {
+                    this_thread::yield();
+                    continue;
+                }
+                // Все источники закончили: то, что они положили, уже видно
+                depth = queue.size();
+                count = queue.tryPopBatch(batch.data(), batchSize);
+                if (count == 0) {
+                    break;
+                }
+            }
+            ++metrics.batches;
+            depthSum += depth;
+            metrics.maxDepth = max(metrics.maxDepth, depth);
+
+            const string* lastCity = nullptr;
+            Rate cityRate;
+            for (size_t i = 0; i < count; ++i) {
+                const RawCall& call = batch[i];
+                if (!lastCity || call.cityName != *lastCity) {
+                    cityRate.found = atc.findRate(call.cityName, cityRate.price, cityRate.currency);
+                    lastCity = &call.cityName;
+                }
+                if (rate(call, cityRate)) {
+                    ++metrics.rated;
+                }
+                else {
+                    ++metrics.rejected;
+                }
+            }
+            auto now = chrono::steady_clock::now();
+            for (size_t i = 0; i < count; ++i) {
+                double latency = chrono::duration<double>(now - batch[i].enqueuedAt).count();
+                latencySum += latency;
+                metrics.maxLatency = max(metrics.maxLatency, latency);
+            }
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+
+        for (const ProducerStats& stats : producerStats) {
+            metrics.produced += stats.produced;
+            metrics.enqueued += stats.enqueued;
+            metrics.waits += stats.waits;
+            metrics.dropped += stats.dropped;
+            metrics.spilled += stats.spilled;
+        }
+        if (policy == BackPressure::Spill) {
+            recoverSpill(metrics);
+        }
+        metrics.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (metrics.batches > 0) {
+            metrics.averageDepth = depthSum / metrics.batches;
+        }
+        if (metrics.enqueued > 0) {
+            metrics.averageLatency = latencySum / metrics.enqueued;
+        }
+        return true;
+    }
+
+    static void print(const Metrics& metrics) {
+        ReportWriter writer;
+        writer.text("Поступило звонков: ").number(static_cast<unsigned long long>(metrics.produced))
+            .text(" за ").number(metrics.seconds, 3).text(" с");
+        if (metrics.seconds > 0) {
+            writer.text(" (").number(metrics.produced / metrics.seconds, 0).text(" звонков/с)");
+        }
+        writer.text("\nПоставлено в очередь: ").number(static_cast<unsigned long long>(metrics.enqueued))
+            .text(", ожиданий места: ").number(static_cast<unsigned long long>(metrics.waits))
+            .text(", отброшено: ").number(static_cast<unsigned long long>(metrics.dropped))
+            .text(", сброшено в файл: ").number(static_cast<unsigned long long>(metrics.spilled))
+            .text(" (дозагружено: ").number(static_cast<unsigned long long>(metrics.recovered)).text(")\n");
+        writer.text("Протарифицировано: ").number(static_cast<unsigned long long>(metrics.rated + metrics.recovered))
+            .text(", отклонено: ").number(static_cast<unsigned long long>(metrics.rejected)).text("\n");
+        writer.text("Очередь: ёмкость ").number(static_cast<unsigned long long>(metrics.capacity))
+            .text(", пачек ").number(static_cast<unsigned long long>(metrics.batches));
+        if (metrics.batches > 0) {
+            writer.text(" (в среднем ").number(static_cast<double>(metrics.enqueued) / metrics.batches, 1).text(" записей)");
+        }
+        writer.text(", глубина средняя ").number(metrics.averageDepth, 1)
+            .text(", максимальная ").number(static_cast<unsigned long long>(metrics.maxDepth)).text("\n");
+        writer.text("Задержка до тарификации: средняя ").number(metrics.averageLatency * 1000, 3)
+            .text(" мс, максимальная ").number(metrics.maxLatency * 1000, 3).text(" мс\n");
+        writer.flush(cout);
+    }
+};
+
+// Ввод числа отдельной строкой; при ошибке поток ввода остаётся исправным
+template <typename T>
+static bool inputNumber(const char* prompt, T& value) {
+    string line;
+    cout << prompt;
+    return getline(cin, line) && parseNumber(line, value);
+}
+
+// Разбор даты в формате ГГГГ-ММ-ДД (местное время, начало суток)
+static bool parseDate(string_view date, time_t& result) {
+    date = trimSpaces(date);
+    const char* end = date.data() + date.size();
+    tm parsed = {};
+    auto part = from_chars(date.data(), end, parsed.tm_year);
+    if (part.ec != errc() || part.ptr == end || *part.ptr != '-') {
+        return false;
+    }
+    part = from_chars(part.ptr + 1, end, parsed.tm_mon);
+    if (part.ec != errc() || part.ptr == end || *part.ptr != '-') {
+        return false;
+    }
+    part = from_chars(part.ptr + 1, end, parsed.tm_mday);
+    if (part.ec != errc() || part.ptr != end || parsed.tm_mon < 1 || parsed.tm_mon > 12
+        || parsed.tm_mday < 1 || parsed.tm_mday > 31) {
+        return false;
+    }
+    parsed.tm_year -= 1900;
+    parsed.tm_mon -= 1;
+    parsed.tm_isdst = -1;
+    result = mktime(&parsed);
+    return result != -1;
+}
+
+// Ввод имени клиента или направления. Кавычка в имени не допускается: в скрипте и журнале
+// событий имена записываются в кавычках без экранирования.
+static bool inputName(const char* prompt, string& name) {
+    cout << prompt;
+    getline(cin, name);
+    if (name.find('"') != string::npos) {
+        cout << "Имя не может содержать кавычки.\n";
+        return false;
+    }
+    return true;
+}
+
+// Ввод кода валюты; пустая строка означает рубли
+static bool inputCurrency(const string& prompt, Currency& currency) {
+    string code;
+    cout << prompt;
+    getline(cin, code);
+    if (code.empty()) {
+        currency = Currency::RUB;
+        return true;
+    }
+    if (!parseCurrency(code, currency)) {
+        cout << "Неизвестная валюта: " << code << "\n";
+        return false;
+    }
+    return true;
+}
+
+static bool inputReportFormat(ReportFormat& format) {
+    int choice;
+    if (!inputNumber("Формат (1 - текст, 2 - CSV, 3 - JSON): ", choice) || choice < 1 || choice > 3) {
+        cout << "Неверный формат.\n";
+        return false;
+    }
+    format = choice == 1 ? ReportFormat::Text : choice == 2 ? ReportFormat::Csv : ReportFormat::Json;
+    return true;
+}
+
+static void clearConsole() {
+#ifdef _WIN32
+    system("cls");
+#else
+    system("clear");
+#endif
+}
+
+// Команды пакетного режима (разбор строк - ScriptInterpreter в Lab_PPP_common.h):
+//
+//   tenant <АТС>                                 выбрать или создать АТС
+//   tariff <город> <цена> [валюта]               добавить тариф
+//   call <клиент> <город> <минуты> [начало [номер [цена валюта]]]
+//                                                звонок по тарифу направления или по явной цене;
+//                                                начало - время Unix
+//   delete <номер>                               удалить звонок
+//   amend <номер> <минуты>                       исправить продолжительность звонка
+//   reprice <город> <цена> [с]                   исправить цену и перетарифицировать звонки,
+//                                                начиная с даты ГГГГ-ММ-ДД или времени Unix
+//   topup <клиент> <сумма>                       пополнить предоплаченный счёт, RUB
+//   exchange <валюта> <рублей>                   установить курс валюты
+//   archive <ГГГГ-ММ-ДД | время Unix>            перенести в архив звонки до даты
+//   generate <seed> <звонков> <клиентов> <направлений>
+//   ingest <источников> <звонков> <клиентов> <направлений> <ёмкость> <block|drop|spill> [файл]
+//                                                приём звонков через очередь; файл - для spill
+//   publish                                      опубликовать свои тарифы в общую память (POSIX)
+//   shared on|off                                тарифицировать по общей таблице или по своим тарифам
+//   revenue [валюта]                             общая выручка
+//   client <клиент> [валюта]                     стоимость звонков клиента
+//   period <ГГГГ-ММ-ДД> <ГГГГ-ММ-ДД> [валюта]    выручка за период, конечная дата включительно
+//   report <client|city|hour> [валюта]           отчёт с группировкой
+//   export <calls|tariffs> <text|csv|json> <файл>
+//   routes <client|city> <имя> [N]               топ направлений клиента или клиентов направления
+//   record <файл> | record off                   начать или закончить журнал событий
+//   checksum                                     контрольная сумма итогов
+//   verify <сумма>                               ошибка, если контрольная сумма итогов другая
+class CommandInterpreter : public ScriptInterpreter {
+public:
+    static constexpr const char* callNotFound = "звонок с таким номером не найден";
+
+    CommandInterpreter(ATCRegistry& registry, const string& tenantName)
+        : registry(&registry), atc(&registry.getOrCreate(tenantName)) {
+    }
+
+    // Работа с одной АТС без реестра: команда tenant недоступна
+    explicit CommandInterpreter(ATC& atc) : registry(nullptr), atc(&atc) {
+    }
+
+protected:
+    // Место под звонки скрипта резервируется заранее (для АТС, выбранной в начале скрипта),
+    // чтобы вектор звонков не перевыделялся по ходу выполнения
+    void prepare(string_view script) override {
+        size_t callLines = 0;
+        size_t pos = 0;
+        while (pos < script.size()) {
+            if (script.compare(pos, 5, "call ") == 0) {
+                ++callLines;
+            }
+            size_t end = script.find('\n', pos);
+            if (end == string_view::npos) {
+                break;
+            }
+            pos = end + 1;
+        }
+        atc->reserveCalls(callLines);
+    }
+
+private:
+    ATCRegistry* registry;
+    ATC* atc;
+
+    // Буферы для имён: после первых команд повторное присваивание не выделяет память
+    string clientName;
+    string cityName;
+
+    void printAmount(const char* label, double amount, Currency currency) {
+        ReportWriter writer;
+        writer.text(label).number(amount, moneyPrecision).text(" ").text(currencyCode(currency)).text("\n");
+        writer.flush(cout);
+    }
+
+    const char* execute(const Command& command) override {
+        const string_view name = command.words[0];
+        const size_t count = command.count;
+        const char* badArguments = "неверное число аргументов";
+        const char* badValue = "некорректное значение аргумента";
+        Currency currency;
+
+        if (name == "call") {
+            if (count < 4 || count == 7 || count > 8) {
+                return badArguments;
+            }
+            clientName.assign(command.words[1]);
+            cityName.assign(command.words[2]);
+            double duration;
+            double price = 0;
+            time_t startTime = 0;
+            unsigned long long id = 0;
+            if (!parseNumber(command.words[3], duration) || duration < 0
+                || (count >= 5 && (!parseNumber(command.words[4], startTime) || startTime < 0))
+                || (count >= 6 && !parseNumber(command.words[5], id))
+                || (count == 8 && (!parseNumber(command.words[6], price) || price < 0 || !parseCurrency(command.words[7], currency)))) {
+                return badValue;
+            }
+            if (count < 8 && !atc->findRate(cityName, price, currency)) {
+                return "нет тарифа для направления";
+            }
+            if (count == 4) {
+                startTime = time(nullptr);
+            }
+            if (count >= 6 && !atc->setNextCallId(id)) {
+                return "номер звонка меньше уже выданных";
+            }
+            if (!atc->rateCall(clientName, cityName, duration, price, startTime, currency)) {
+                return "звонок отклонён: недостаточно средств на счёте";
+            }
+            return nullptr;
+        }
+        if (name == "tariff") {
+            double price;
+            if (count < 3 || count > 4) {
+                return badArguments;
+            }
+            if (!parseNumber(command.words[2], price) || price < 0 || !optionalCurrency(command, 3, currency)) {
+                return badValue;
+            }
+            atc->addTariff(string(command.words[1]), price, currency);
+            return nullptr;
+        }
+        if (name == "tenant") {
+            if (count != 2 || command.words[1].empty()) {
+                return badArguments;
+            }
+            if (!registry) {
+                return "смена АТС здесь недоступна";
+            }
+            atc = &registry->getOrCreate(string(command.words[1]));
+            return nullptr;
+        }
+        if (name == "delete" || name == "amend") {
+            unsigned long long id;
+            double duration = 0;
+            if (count != (name == "delete" ? 2u : 3u)) {
+                return badArguments;
+            }
+            if (!parseNumber(command.words[1], id) || (count == 3 && (!parseNumber(command.words[2], duration) || duration < 0))) {
+                return badValue;
+            }
+            bool found = count == 2 ? atc->deleteCall(id) : atc->amendCall(id, duration);
+            return found ? nullptr : callNotFound;
+        }
+        if (name == "reprice") {
+            double price;
+            time_t since = 0;
+            if (count < 3 || count > 4) {
+                return badArguments;
+            }
+            cityName.assign(command.words[1]);
+            int index = atc->findTariff(cityName);
+            if (index < 0) {
+                return "нет тарифа для направления";
+            }
+            if (!parseNumber(command.words[2], price) || price < 0
+                || (count == 4 && !parseDate(command.words[3], since) && !parseNumber(command.words[3], since))) {
+                return badValue;
+            }
+            atc->setTariffPrice(index, price);
+            atc->rerateCalls(index, since);
+            return nullptr;
+        }
+        if (name == "topup") {
+            double amount;
+            if (count != 3) {
+                return badArguments;
+            }
+            if (!parseNumber(command.words[2], amount) || amount < 0) {
+                return badValue;
+            }
+            atc->topUpPrepaid(string(command.words[1]), amount);
+            return nullptr;
+        }
+        if (name == "exchange") {
+            double rubles;
+            if (count != 3) {
+                return badArguments;
+            }
+            if (!parseCurrency(command.words[1], currency) || !parseNumber(command.words[2], rubles)
+                || !atc->setExchangeRate(currency, rubles)) {
+                return badValue;
+            }
+            return nullptr;
+        }
+        if (name == "archive") {
+            time_t cutoff;
+            if (count != 2) {
+                return badArguments;
+            }
+            if (!parseDate(command.words[1], cutoff) && !parseNumber(command.words[1], cutoff)) {
+                return badValue;
+            }
+            atc->archiveCallsBefore(cutoff);
+            return nullptr;
+        }
+        if (name == "generate") {
+            unsigned long long seed;
+            size_t callCount, clientCount, cityCount;
+            if (count != 5) {
+                return badArguments;
+            }
+            if (!parseNumber(command.words[1], seed) || !parseNumber(command.words[2], callCount)
+                || !parseNumber(command.words[3], clientCount) || !parseNumber(command.words[4], cityCount)
+                || clientCount == 0 || cityCount == 0) {
+                return badValue;
+            }
+            LoadGenerator(seed, clientCount, cityCount).run(*atc, callCount);
+            return nullptr;
+        }
+        if (name == "ingest") {
+            size_t producerCount, callCount, clientCount, cityCount, capacity;
+            IngestPipeline::BackPressure policy;
+            if (count != 7 && count != 8) {
+                return badArguments;
+            }
+            if (!parseNumber(command.words[1], producerCount) || !parseNumber(command.words[2], callCount)
+                || !parseNumber(command.words[3], clientCount) || !parseNumber(command.words[4], cityCount)
+                || !parseNumber(command.words[5], capacity) || !IngestPipeline::parseBackPressure(command.words[6], policy)
+                || producerCount == 0 || clientCount == 0 || cityCount == 0
+                || capacity == 0 || capacity > IngestPipeline::maxCapacity
+                || (policy == IngestPipeline::BackPressure::Spill) != (count == 8)) {
+                return badValue;
+            }
+            IngestPipeline::Metrics metrics;
+            IngestPipeline pipeline(*atc, capacity, policy, count == 8 ? string(command.words[7]) : string());
+            if (!pipeline.run(producerCount, callCount, clientCount, cityCount, metrics)) {
+                return "не удалось открыть файл";
+            }
+            IngestPipeline::print(metrics);
+            return nullptr;
+        }
+#ifndef _WIN32
+        if (name == "publish") {
+            if (count != 1) {
+                return badArguments;
+            }
+            SharedTariffTable* table = sharedTariffsForWriting();
+            if (!table) {
+                return "не удалось открыть общую память";
+            }
+            vector<TariffRow> rows = atc->getTariffRows();
+            if (const TariffRow* row = SharedTariffTable::findTooLong(rows)) {
+                cout << "Направление не помещается в общую таблицу: " << row->destination << "\n";
+                return "таблица не опубликована: название направления длиннее 111 байт";
+            }
+            if (table->publish(rows) == 0) {
+                return "таблица не опубликована: слишком много тарифов или запись занята другим процессом";
+            }
+            return nullptr;
+        }
+        if (name == "shared") {
+            if (count != 2 || (command.words[1] != "on" && command.words[1] != "off")) {
+                return badArguments;
+            }
+            if (command.words[1] == "off") {
+                atc->useSharedTariffs(nullptr);
+                return nullptr;
+            }
+            const SharedTariffTable* table = sharedTariffsForReading();
+            if (!table) {
+                return "общая таблица тарифов ещё не опубликована";
+            }
+            atc->useSharedTariffs(table);
+            return nullptr;
+        }
+#endif
+        if (name == "revenue") {
+            if (count > 2) {
+                return badArguments;
+            }
+            if (!optionalCurrency(command, 1, currency)) {
+                return badValue;
+            }
+            printAmount("Общая выручка за все звонки: ", atc->getTotalRevenue(currency), currency);
+            return nullptr;
+        }
+        if (name == "client") {
+            if (count < 2 || count > 3) {
+                return badArguments;
+            }
+            if (!optionalCurrency(command, 2, currency)) {
+                return badValue;
+            }
+            clientName.assign(command.words[1]);
+            ReportWriter writer;
+            writer.text("Общая стоимость звонков клиента ").text(clientName).text(": ")
+                .number(atc->getClientTotalCallsCost(clientName, currency), moneyPrecision)
+                .text(" ").text(currencyCode(currency)).text("\n");
+            writer.flush(cout);
+            return nullptr;
+        }
+        if (name == "period") {
+            time_t from, to;
+            if (count < 3 || count > 4) {
+                return badArguments;
+            }
+            if (!parseDate(command.words[1], from) || !parseDate(command.words[2], to) || !optionalCurrency(command, 3, currency)) {
+                return badValue;
+            }
+            printAmount("Выручка за период: ", atc->getRevenueForPeriod(from, to + 86400 - 1, currency), currency);
+            return nullptr;
+        }
+        if (name == "report") {
+            if (count < 2 || count > 3) {
+                return badArguments;
+            }
+            string_view key = command.words[1];
+            if ((key != "client" && key != "city" && key != "hour") || !optionalCurrency(command, 2, currency)) {
+                return badValue;
+            }
+            GroupBy groupBy = key == "client" ? GroupBy::Client : key == "city" ? GroupBy::City : GroupBy::Hour;
+            CallAnalytics::print(CallAnalytics::run(*atc, groupBy, numeric_limits<time_t>::min(),
+                numeric_limits<time_t>::max(), currency), 50);
+            return nullptr;
+        }
+        if (name == "export") {
+            if (count != 4) {
+                return badArguments;
+            }
+            string_view what = command.words[1];
+            string_view formatName = command.words[2];
+            if ((what != "calls" && what != "tariffs") || (formatName != "text" && formatName != "csv" && formatName != "json")) {
+                return badValue;
+            }
+            ReportFormat format = formatName == "text" ? ReportFormat::Text
+                : formatName == "csv" ? ReportFormat::Csv : ReportFormat::Json;
+            ofstream file(string(command.words[3]), ios::binary);
+            if (!file) {
+                return "не удалось открыть файл";
+            }
+            if (what == "calls") {
+                atc->exportCalls(file, format);
+            }
+            else {
+                atc->exportTariffs(file, format);
+            }
+            return nullptr;
+        }
+        if (name == "routes") {
+            size_t limit = 10;
+            if (count < 3 || count > 4) {
+                return badArguments;
+            }
+            string_view key = command.words[1];
+            if ((key != "client" && key != "city") || (count == 4 && !parseNumber(command.words[3], limit))) {
+                return badValue;
+            }
+            clientName.assign(command.words[2]);
+            const UsageMatrix& usage = atc->getUsage();
+            UsageMatrix::print(key == "client" ? usage.topCities(clientName, limit) : usage.topClients(clientName, limit));
+            return nullptr;
+        }
+        if (name == "record") {
+            if (count != 2) {
+                return badArguments;
+            }
+            if (command.words[1] == "off") {
+                atc->stopRecording();
+                return nullptr;
+            }
+            if (!atc->canStartRecording()) {
+                return "журнал можно начать только на пустой АТС";
+            }
+            return atc->startRecording(string(command.words[1])) ? nullptr : "не удалось открыть файл";
+        }
+        if (name == "checksum" || name == "verify") {
+            unsigned long long expected = 0;
+            if (count != (name == "checksum" ? 1u : 2u)) {
+                return badArguments;
+            }
+            if (count == 2 && !parseNumber(command.words[1], expected)) {
+                return badValue;
+            }
+            if (count == 1) {
+                cout << "Контрольная сумма итогов: " << atc->getTotalsChecksum() << "\n";
+                return nullptr;
+            }
+            return atc->getTotalsChecksum() == expected ? nullptr : "контрольная сумма итогов не совпадает";
+        }
+        return "неизвестная команда";
     }
 };
 
-class ATC {
-private:
-    vector<Tariff> tariffs;
-    vector<Call> calls;
-    double totalRevenue;
-    ATC() : totalRevenue(0) {}
-
-    ATC(const ATC&) = delete;
-    ATC& operator=(const ATC&) = delete;
-
+// Восстановление АТС из журнала событий. Журнал делится по клиентам: звонки и пополнения клиента
+// попадают в одну часть, а общие события (тарифы, курсы, перетарификация, удаление и исправление
+// звонков по номеру) - в каждую. Части выполняются параллельно, каждая над своей АТС и в порядке
+// журнала, поэтому цены и номера звонков те же, что при последовательном выполнении; затем части
+// сливаются. Итог сверяется с контрольной суммой из последней строки verify журнала.
+class EventReplay {
 public:
-    static ATC& getInstance() {
-        static ATC instance;
-        return instance;
-    }
+    struct Result {
+        size_t events = 0;
+        size_t errors = 0;
+        bool hasChecksum = false;
+        uint64_t expectedChecksum = 0;
+        size_t partitions = 1;
+    };
 
-    ~ATC() {
-        cout << "Деструктор для ATC\n";
-    }
+    static Result run(string_view log, size_t partitionCount, ATC& target) {
+        Result result;
+        partitionCount = max<size_t>(1, partitionCount);
+        result.partitions = partitionCount;
+        target.setVerbose(false);
 
-    const vector<Tariff>& getTariffs() const {
-        return tariffs;
-    }
+        // Части хранят только string_view строк журнала; номер строки вычисляется лишь для сообщения об ошибке
+        vector<vector<string_view>> partitions(partitionCount);
+        vector<size_t> partitionCalls(partitionCount, 0);
+        vector<pair<size_t, const char*>> errors;
+        CommandInterpreter::Command command;
+        string_view rest = log;
+        while (!rest.empty()) {
+            size_t end = rest.find('\n');
+            string_view line = rest.substr(0, end);
+            rest.remove_prefix(end == string_view::npos ? rest.size() : end + 1);
 
-    void addTariff(const string& cityName, double price) {
-        tariffs.emplace_back(cityName, price);
-        cout << "Тариф добавлен успешно: " << cityName << " по цене " << price << " за минуту\n";
-    }
+            if (!CommandInterpreter::tokenize(line, command)) {
+                errors.push_back({ static_cast<size_t>(line.data() - log.data()), "ошибка синтаксиса" });
+                continue;
+            }
+            if (command.count == 0) {
+                continue;
+            }
+            ++result.events;
+            string_view name = command.words[0];
+            if (name == "verify") {
+                result.hasChecksum = command.count == 2 && parseNumber(command.words[1], result.expectedChecksum);
+                continue;
+            }
+            // Сумма, записанная до последующих событий, к итогу уже не относится
+            result.hasChecksum = false;
+            // Архивы частей не сливаются, поэтому журнал с архивацией восстанавливается одним потоком
+            if (name == "archive" && partitionCount > 1) {
+                return run(log, 1, target);
+            }
+            if ((name == "call" || name == "topup") && command.count >= 2) {
+                size_t partition = hash<string_view>()(command.words[1]) % partitionCount;
+                partitions[partition].push_back(line);
+                partitionCalls[partition] += name == "call";
+            }
+            else {
+                for (auto& partition : partitions) {
+                    partition.push_back(line);
+                }
+            }
+        }
 
-    int printTariffs() const {
-        cout << "Список тарифов:\n";
-        if (tariffs.empty()) {
-            cout << "Список тарифов пуст.\n";
-            return 0;
+        // Одна часть восстанавливается прямо в целевую АТС, без слияния
+        vector<unique_ptr<ATC>> parts;
+        vector<vector<pair<size_t, const char*>>> partErrors(partitionCount);
+        for (size_t i = 0; i < partitionCount && partitionCount > 1; ++i) {
+            parts.push_back(make_unique<ATC>(target.getName()));
+            parts.back()->setVerbose(false);
         }
-        else {
-            for (size_t i = 0; i < tariffs.size(); ++i) {
-                cout << i + 1 << ". " << tariffs[i].cityName << " - " << tariffs[i].price << " за минуту\n";
+        auto work = [&](size_t partition) {
+            ATC& atc = partitionCount > 1 ? *parts[partition] : target;
+            atc.reserveCalls(partitionCalls[partition]);
+            CommandInterpreter interpreter(atc);
+            for (string_view line : partitions[partition]) {
+                const char* error = interpreter.executeLine(line);
+                // Удаление и исправление выполняются во всех частях, а звонок есть только в одной
+                if (error && error != CommandInterpreter::callNotFound) {
+                    partErrors[partition].push_back({ static_cast<size_t>(line.data() - log.data()), error });
+                }
             }
+        };
+        vector<thread> threads;
+        for (size_t partition = 1; partition < partitionCount; ++partition) {
+            threads.emplace_back(work, partition);
         }
-    }
-
-    double getFarePrice(int index) const {
-        if (index >= 0 && index < tariffs.size()) {
-            return tariffs[index].price;
+        work(0);
+        for (auto& t : threads) {
+            t.join();
+        }
+        if (partitionCount > 1 && !target.mergePartitions(parts)) {
+            errors.push_back({ 0, "восстанавливать журнал по частям можно только в пустую АТС" });
         }
-        return 0.0;
-    }
-
-
-    void registerCall(const string& clientName, const string& cityName, double duration, double pricePerMinute) {
-        double totalCost = duration * pricePerMinute;
-        totalRevenue += totalCost;
-        calls.emplace_back(clientName, cityName, duration, totalCost);
-        cout << "Звонок зарегистрирован: " << clientName << " -> " << cityName << ", стоимость: " << totalCost << endl;
-    }
-
-
-    double getTotalRevenue() const {
-        return totalRevenue;
-    }
 
-    double getClientTotalCallsCost(const string& clientName) const {
-        double clientTotal = 0;
-        for (const auto& call : calls) {
-            if (call.clientName == clientName) {
-                clientTotal += call.price;
-            }
+        // Ошибка общего события повторяется в каждой части; выводится один раз
+        for (const auto& part : partErrors) {
+            errors.insert(errors.end(), part.begin(), part.end());
+        }
+        sort(errors.begin(), errors.end());
+        errors.erase(unique(errors.begin(), errors.end()), errors.end());
+        for (const auto& error : errors) {
+            size_t lineNumber = count(log.begin(), log.begin() + error.first, '\n') + 1;
+            cerr << "Строка " << lineNumber << ": " << error.second << "\n";
         }
-        return clientTotal;
+        result.errors = errors.size();
+        return result;
     }
 };
 
-
-static void clearConsole() {
-#ifdef _WIN32
-    system("cls");
-#else
-    system("clear");
-#endif
-}
-
 // Главное меню
 static void menu() {
-    ATC& atc = ATC::getInstance();
+    ATCRegistry registry;
+    string tenantName = "Основная";
     bool OnDisplay = true;
 
     while (OnDisplay) {
+        ATC& atc = registry.getOrCreate(tenantName);
         clearConsole();
 
-        cout << "===== Система управления ATC =====\n";
+        cout << "===== Система управления ATC (" << atc.getName() << ") =====\n";
         cout << "1. Добавить новый тариф\n";
         cout << "2. Просмотреть все тарифы\n";
         cout << "3. Зарегистрировать звонок\n";
         cout << "4. Просмотреть общую выручку за все звонки\n";
         cout << "5. Рассчитать стоимость всех звонков клиента\n";
+        cout << "6. Сгенерировать тестовую нагрузку\n";
+        cout << "7. Поиск и постраничный просмотр тарифов\n";
+        cout << "8. Показать звонки клиента\n";
+        cout << "9. Удалить звонок\n";
+        cout << "10. Исправить длительность звонка\n";
+        cout << "11. Исправить цену тарифа и перетарифицировать звонки\n";
+        cout << "12. Показать подозрительные звонки\n";
+        cout << "13. Выбрать или создать АТС\n";
+        cout << "14. Список АТС\n";
+        cout << "15. Удалить АТС\n";
+        cout << "16. Перенести старые звонки в архив\n";
+        cout << "17. Выручка за период\n";
+        cout << "18. Отчёт по звонкам с группировкой\n";
+        cout << "19. Пополнить предоплаченный счёт клиента\n";
+        cout << "20. Показать баланс клиента\n";
+        cout << "21. Установить курс валюты\n";
+        cout << "22. Выгрузить звонки в файл\n";
+        cout << "23. Выгрузить тарифы в файл\n";
+        cout << "24. Кто куда звонит: направления клиента и клиенты направления\n";
+        cout << (atc.isRecording() ? "25. Остановить журнал событий\n" : "25. Начать журнал событий в файл\n");
+        cout << "26. Приём звонков через очередь (нагрузочный прогон)\n";
+#ifndef _WIN32
+        cout << "27. Опубликовать тарифы в общую память\n";
+        cout << (atc.isUsingSharedTariffs() ? "28. Тарифицировать по своим тарифам\n" : "28. Тарифицировать по общей таблице тарифов\n");
+#endif
         cout << "0. Выход\n";
         cout << "=============================================\n";
 
-        int choice;
+        string line;
         cout << "Выберите опцию: ";
-        cin >> choice;
-        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        if (!getline(cin, line)) {
+            break;
+        }
+        // from_chars записывает число и при мусоре после него, поэтому результат разбора проверяется
+        int choice;
+        if (!parseNumber(line, choice)) {
+            choice = -1;
+        }
 
         switch (choice) {
         case 1: {
             string cityName;
-            cout << "Введите название города: ";
-            getline(cin, cityName);
+            if (!inputName("Введите название города: ", cityName)) {
+                break;
+            }
             double price = 0;
-            cout << "Введите цену за минуту разговора: ";
-            cin >> price;
-            if (price < 0) {
-                cout << "Цена за минуту не может быть отрицательной\n";
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            if (!inputNumber("Введите цену за минуту разговора: ", price) || price < 0) {
+                cout << "Цена за минуту должна быть неотрицательным числом\n";
+                break;
+            }
+            Currency currency;
+            if (!inputCurrency("Введите валюту тарифа (RUB, USD, EUR; пусто - RUB): ", currency)) {
                 break;
             }
-            atc.addTariff(cityName, price);
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            atc.addTariff(cityName, price, currency);
             break;
         }
         case 2:
             atc.printTariffs();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
             break;
         case 3: {
             string clientName;
             if (atc.printTariffs() == 0) {
                 cout << "Сначало введите хотя бы 1 тариф.\n";
-                cin.ignore(numeric_limits<streamsize>::max(), '\n');
 				break;
             }
-            cout << "Введите имя клиента: ";
-            getline(cin, clientName);
+            if (!inputName("Введите имя клиента: ", clientName)) {
+                break;
+            }
 
             atc.printTariffs();
             int tariffIndex;
-            cout << "Выберите тариф (введите номер): ";
-            cin >> tariffIndex;
+            if (!inputNumber("Выберите тариф (введите номер): ", tariffIndex)
+                || tariffIndex < 1 || tariffIndex > static_cast<int>(atc.getTariffs().size())) {
+                cout << "Тарифа с таким номером нет.\n";
+                break;
+            }
             --tariffIndex;
 
             double duration;
-            cout << "Введите продолжительность звонка (в минутах): ";
-            cin >> duration;
+            if (!inputNumber("Введите продолжительность звонка (в минутах): ", duration)) {
+                cout << "Продолжительность должна быть числом.\n";
+                break;
+            }
 
-            double pricePerMinute = atc.getFarePrice(tariffIndex);
-            atc.registerCall(clientName, atc.getTariffs()[tariffIndex].cityName, duration, pricePerMinute);
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            // На своих тарифах действует выбранный тариф (у направления их может быть несколько),
+            // на общей таблице - её цена направления
+            const string cityName = atc.getTariffs()[tariffIndex].cityName;
+            double price = atc.getFarePrice(tariffIndex);
+            Currency currency = atc.getTariffs()[tariffIndex].currency;
+#ifndef _WIN32
+            if (atc.isUsingSharedTariffs() && !atc.findRate(cityName, price, currency)) {
+                cout << "Направления " << cityName << " нет в общей таблице тарифов.\n";
+                break;
+            }
+#endif
+            atc.registerCall(clientName, cityName, duration, price, currency);
             break;
         }
-        case 4:
-            cout << "Общая выручка за все звонки: " << atc.getTotalRevenue() << endl;
+        case 4: {
+            Currency currency;
+            if (!inputCurrency("Валюта отчёта (RUB, USD, EUR; пусто - RUB): ", currency)) {
+                break;
+            }
+            ReportWriter writer;
+            writer.text("Общая выручка за все звонки: ").number(atc.getTotalRevenue(currency), moneyPrecision)
+                .text(" ").text(currencyCode(currency)).text("\n");
+            writer.flush(cout);
             break;
+        }
         case 5: {
             string clientName;
             cout << "Введите имя клиента: ";
             getline(cin, clientName);
-            double totalCost = atc.getClientTotalCallsCost(clientName);
-            cout << "Общая стоимость звонков клиента " << clientName << ": " << totalCost << endl;
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            Currency currency;
+            if (!inputCurrency("Валюта отчёта (RUB, USD, EUR; пусто - RUB): ", currency)) {
+                break;
+            }
+            ReportWriter writer;
+            writer.text("Общая стоимость звонков клиента ").text(clientName).text(": ")
+                .number(atc.getClientTotalCallsCost(clientName, currency), moneyPrecision).text(" ").text(currencyCode(currency)).text("\n");
+            writer.flush(cout);
+            break;
+        }
+        case 6: {
+            unsigned long long seed;
+            size_t count, clientCount, cityCount;
+            int mode;
+            if (!inputNumber("Введите seed генератора: ", seed)
+                || !inputNumber("Введите количество звонков: ", count)
+                || !inputNumber("Введите количество клиентов: ", clientCount)
+                || !inputNumber("Введите количество направлений: ", cityCount)
+                || !inputNumber("Куда направить звонки (1 - в АТС, 2 - CSV файл, 3 - бинарный файл): ", mode)
+                || clientCount == 0 || cityCount == 0 || mode < 1 || mode > 3) {
+                cout << "Некорректные параметры генератора.\n";
+                break;
+            }
+
+            LoadGenerator generator(seed, clientCount, cityCount);
+            auto start = chrono::steady_clock::now();
+            if (mode == 1) {
+                generator.run(atc, count);
+            }
+            else {
+                string fileName;
+                cout << "Введите имя файла: ";
+                getline(cin, fileName);
+                ofstream file(fileName, ios::binary);
+                if (!file) {
+                    cout << "Не удалось открыть файл " << fileName << endl;
+                    break;
+                }
+                generator.write(file, count, mode == 2 ? LoadGenerator::OutputFormat::Csv : LoadGenerator::OutputFormat::Binary);
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cout << "Сгенерировано звонков: " << count << " за " << seconds << " с";
+            if (seconds > 0) {
+                cout << " (" << static_cast<long long>(count / seconds) << " звонков/с)";
+            }
+            cout << endl;
+            break;
+        }
+        case 7: {
+            int sortChoice;
+            if (!inputNumber("Сортировать по (1 - названию, 2 - цене): ", sortChoice) || (sortChoice != 1 && sortChoice != 2)) {
+                cout << "Неверный выбор сортировки.\n";
+                break;
+            }
+            TariffSort order = sortChoice == 1 ? TariffSort::ByName : TariffSort::ByPrice;
+
+            string filter;
+            cout << "Введите строку поиска (пусто - все тарифы): ";
+            getline(cin, filter);
+            bool prefixOnly = false;
+            if (!filter.empty()) {
+                string answer;
+                cout << "Искать только по началу названия? (д/н): ";
+                getline(cin, answer);
+                prefixOnly = answer == "д" || answer == "Д" || answer == "y";
+            }
+
+            const size_t pageSize = 20;
+            size_t cursor = 0;
+            while (true) {
+                cursor = atc.printTariffsPage(order, filter, prefixOnly, cursor, pageSize);
+                if (cursor >= atc.getTariffs().size()) {
+                    break;
+                }
+                string answer;
+                cout << "Enter - следующая страница, q - выход: ";
+                getline(cin, answer);
+                if (answer == "q") {
+                    break;
+                }
+            }
+            break;
+        }
+        case 8: {
+            string clientName;
+            cout << "Введите имя клиента: ";
+            getline(cin, clientName);
+            atc.printClientCalls(clientName);
+            break;
+        }
+        case 9: {
+            unsigned long long id;
+            if (!inputNumber("Введите номер звонка: ", id) || !atc.deleteCall(id)) {
+                cout << "Звонок с таким номером не найден.\n";
+                break;
+            }
+            cout << "Звонок №" << id << " удалён.\n";
+            break;
+        }
+        case 10: {
+            unsigned long long id;
+            double duration;
+            if (!inputNumber("Введите номер звонка: ", id)
+                || !inputNumber("Введите исправленную продолжительность звонка (в минутах): ", duration) || duration < 0) {
+                cout << "Некорректные данные.\n";
+                break;
+            }
+            if (!atc.amendCall(id, duration)) {
+                cout << "Звонок с таким номером не найден.\n";
+                break;
+            }
+            cout << "Звонок №" << id << " исправлен.\n";
+            break;
+        }
+        case 11: {
+            if (atc.printTariffs() == 0) {
+                break;
+            }
+            int tariffIndex;
+            double price;
+            if (!inputNumber("Выберите тариф (введите номер): ", tariffIndex)
+                || !inputNumber("Введите исправленную цену за минуту: ", price)
+                || price < 0 || tariffIndex < 1 || tariffIndex > static_cast<int>(atc.getTariffs().size())) {
+                cout << "Некорректные данные.\n";
+                break;
+            }
+            --tariffIndex;
+
+            string date;
+            cout << "Перетарифицировать звонки начиная с даты ГГГГ-ММ-ДД (пусто - все звонки): ";
+            getline(cin, date);
+            time_t since = 0;
+            if (!date.empty() && !parseDate(date, since)) {
+                cout << "Некорректная дата.\n";
+                break;
+            }
+
+            atc.setTariffPrice(tariffIndex, price);
+            size_t rerated = atc.rerateCalls(tariffIndex, since);
+            cout << "Перетарифицировано звонков: " << rerated << endl;
+            if (atc.isArchivedSince(since)) {
+                cout << "Внимание: часть звонков за этот период уже в архиве и не перетарифицирована.\n";
+            }
+            break;
+        }
+        case 12:
+            atc.printFraudAlerts();
+            break;
+        case 13: {
+            string name;
+            cout << "Введите название АТС: ";
+            getline(cin, name);
+            if (name.empty()) {
+                cout << "Название АТС не может быть пустым.\n";
+                break;
+            }
+            tenantName = name;
+            cout << "Текущая АТС: " << tenantName << endl;
+            break;
+        }
+        case 14:
+            registry.printTenants();
+            break;
+        case 15: {
+            string name;
+            cout << "Введите название АТС: ";
+            getline(cin, name);
+            if (name == tenantName) {
+                cout << "Нельзя удалить текущую АТС.\n";
+                break;
+            }
+            if (!registry.remove(name)) {
+                cout << "АТС с таким названием не найдена.\n";
+                break;
+            }
+            cout << "АТС " << name << " удалена.\n";
+            break;
+        }
+        case 16: {
+            string date;
+            time_t cutoff;
+            cout << "Перенести в архив звонки, начавшиеся до даты ГГГГ-ММ-ДД: ";
+            getline(cin, date);
+            if (!parseDate(date, cutoff)) {
+                cout << "Некорректная дата.\n";
+                break;
+            }
+            size_t archived = atc.archiveCallsBefore(cutoff);
+            cout << "Перенесено в архив звонков: " << archived
+                << ", размер архива: " << atc.getArchive().getMemoryUsage() / 1024 << " КБ\n";
+            break;
+        }
+        case 17: {
+            string fromDate, toDate;
+            time_t from, to;
+            cout << "Введите начальную дату ГГГГ-ММ-ДД: ";
+            getline(cin, fromDate);
+            cout << "Введите конечную дату ГГГГ-ММ-ДД (включительно): ";
+            getline(cin, toDate);
+            if (!parseDate(fromDate, from) || !parseDate(toDate, to)) {
+                cout << "Некорректная дата.\n";
+                break;
+            }
+            to += 86400 - 1;
+            Currency currency;
+            if (!inputCurrency("Валюта отчёта (RUB, USD, EUR; пусто - RUB): ", currency)) {
+                break;
+            }
+            ReportWriter writer;
+            writer.text("Выручка за период: ").number(atc.getRevenueForPeriod(from, to, currency), moneyPrecision)
+                .text(" ").text(currencyCode(currency)).text("\n");
+            writer.flush(cout);
+            break;
+        }
+        case 18: {
+            int groupChoice;
+            if (!inputNumber("Группировать по (1 - клиенту, 2 - направлению, 3 - часу суток): ", groupChoice)
+                || groupChoice < 1 || groupChoice > 3) {
+                cout << "Неверный выбор группировки.\n";
+                break;
+            }
+            GroupBy groupBy = groupChoice == 1 ? GroupBy::Client
+                : groupChoice == 2 ? GroupBy::City : GroupBy::Hour;
+
+            string fromDate, toDate;
+            time_t from = numeric_limits<time_t>::min();
+            time_t to = numeric_limits<time_t>::max();
+            cout << "Введите начальную дату ГГГГ-ММ-ДД (пусто - без ограничения): ";
+            getline(cin, fromDate);
+            cout << "Введите конечную дату ГГГГ-ММ-ДД (пусто - без ограничения): ";
+            getline(cin, toDate);
+            if ((!fromDate.empty() && !parseDate(fromDate, from)) || (!toDate.empty() && !parseDate(toDate, to))) {
+                cout << "Некорректная дата.\n";
+                break;
+            }
+            if (!toDate.empty()) {
+                to += 86400 - 1;
+            }
+            Currency currency;
+            if (!inputCurrency("Валюта отчёта (RUB, USD, EUR; пусто - RUB): ", currency)) {
+                break;
+            }
+
+            auto start = chrono::steady_clock::now();
+            vector<CallAnalytics::GroupRow> rows = CallAnalytics::run(atc, groupBy, from, to, currency);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            CallAnalytics::print(rows, 50);
+            cout << "Отчёт построен за " << seconds << " с\n";
+            break;
+        }
+        case 19: {
+            string clientName;
+            double amount;
+            if (!inputName("Введите имя клиента: ", clientName)) {
+                break;
+            }
+            if (!inputNumber("Введите сумму пополнения: ", amount) || amount < 0) {
+                cout << "Сумма пополнения должна быть неотрицательным числом.\n";
+                break;
+            }
+            atc.topUpPrepaid(clientName, amount);
+            double balance = 0;
+            atc.getPrepaidBalance(clientName, balance);
+            ReportWriter writer;
+            writer.text("Баланс клиента ").text(clientName).text(": ").number(balance, moneyPrecision).text(" RUB\n");
+            writer.flush(cout);
+            break;
+        }
+        case 20: {
+            string clientName;
+            cout << "Введите имя клиента: ";
+            getline(cin, clientName);
+            double balance;
+            if (!atc.getPrepaidBalance(clientName, balance)) {
+                cout << "У клиента " << clientName << " нет предоплаченного счёта.\n";
+                break;
+            }
+            ReportWriter writer;
+            writer.text("Баланс клиента ").text(clientName).text(": ").number(balance, moneyPrecision).text(" RUB\n");
+            writer.flush(cout);
+            break;
+        }
+        case 21: {
+            Currency currency;
+            if (!inputCurrency("Введите валюту (USD, EUR): ", currency)) {
+                break;
+            }
+            double rubles;
+            if (!inputNumber("Введите стоимость единицы валюты в рублях: ", rubles) || !atc.setExchangeRate(currency, rubles)) {
+                cout << "Курс можно задать только для USD и EUR положительным числом.\n";
+                break;
+            }
+            cout << "Курс " << currencyCode(currency) << " установлен: " << rubles << " RUB\n";
+            break;
+        }
+        case 22:
+        case 23: {
+            ReportFormat format;
+            if (!inputReportFormat(format)) {
+                break;
+            }
+            string fileName;
+            cout << "Введите имя файла: ";
+            getline(cin, fileName);
+            ofstream file(fileName, ios::binary);
+            if (!file) {
+                cout << "Не удалось открыть файл " << fileName << "\n";
+                break;
+            }
+            if (choice == 23) {
+                atc.exportTariffs(file, format);
+                cout << "Тарифы выгружены в " << fileName << "\n";
+                break;
+            }
+            auto start = chrono::steady_clock::now();
+            size_t exported = atc.exportCalls(file, format);
+            file.flush();
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cout << "Выгружено звонков: " << exported << " за " << seconds << " с\n";
+            break;
+        }
+        case 24: {
+            int mode;
+            size_t limit;
+            string name;
+            if (!inputNumber("Показать (1 - направления клиента, 2 - клиентов направления): ", mode) || (mode != 1 && mode != 2)) {
+                cout << "Неверный выбор.\n";
+                break;
+            }
+            cout << (mode == 1 ? "Введите имя клиента: " : "Введите название города: ");
+            getline(cin, name);
+            if (!inputNumber("Сколько строк показать: ", limit)) {
+                cout << "Некорректное число строк.\n";
+                break;
+            }
+            const UsageMatrix& usage = atc.getUsage();
+            auto start = chrono::steady_clock::now();
+            vector<UsageMatrix::RouteUsage> routes = mode == 1 ? usage.topCities(name, limit) : usage.topClients(name, limit);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            UsageMatrix::print(routes);
+            cout << "Рёбер в матрице: " << usage.getEdgeCount() << ", в дельте: " << usage.getDeltaSize()
+                << ", запрос за " << seconds << " с\n";
+            break;
+        }
+        case 25: {
+            if (atc.isRecording()) {
+                atc.stopRecording();
+                cout << "Журнал событий закрыт, в конец записана контрольная сумма итогов.\n";
+                break;
+            }
+            if (!atc.canStartRecording()) {
+                cout << "Журнал можно начать только на пустой АТС: восстановление начинается без тарифов, звонков и счетов.\n";
+                break;
+            }
+            string fileName;
+            cout << "Введите имя файла журнала: ";
+            getline(cin, fileName);
+            if (!atc.startRecording(fileName)) {
+                cout << "Не удалось открыть файл " << fileName << "\n";
+                break;
+            }
+            cout << "Изменения АТС " << atc.getName() << " записываются в " << fileName
+                << ". Восстановление: --replay " << fileName << "\n";
+            break;
+        }
+        case 26: {
+            size_t producerCount, callCount, clientCount, cityCount, capacity;
+            int mode;
+            if (!inputNumber("Введите количество источников (потоков): ", producerCount)
+                || !inputNumber("Введите количество звонков: ", callCount)
+                || !inputNumber("Введите количество клиентов: ", clientCount)
+                || !inputNumber("Введите количество направлений: ", cityCount)
+                || !inputNumber("Введите ёмкость очереди (не больше 1048576): ", capacity)
+                || !inputNumber("При переполнении (1 - ждать, 2 - отбрасывать, 3 - сбрасывать в файл): ", mode)
+                || producerCount == 0 || clientCount == 0 || cityCount == 0 || mode < 1 || mode > 3
+                || capacity == 0 || capacity > IngestPipeline::maxCapacity) {
+                cout << "Некорректные параметры приёма.\n";
+                break;
+            }
+            IngestPipeline::BackPressure policy = mode == 1 ? IngestPipeline::BackPressure::Block
+                : mode == 2 ? IngestPipeline::BackPressure::Drop : IngestPipeline::BackPressure::Spill;
+            string fileName;
+            if (policy == IngestPipeline::BackPressure::Spill) {
+                cout << "Введите имя файла сброса: ";
+                getline(cin, fileName);
+            }
+            IngestPipeline::Metrics metrics;
+            IngestPipeline pipeline(atc, capacity, policy, fileName);
+            if (!pipeline.run(producerCount, callCount, clientCount, cityCount, metrics)) {
+                cout << "Не удалось открыть файл " << fileName << "\n";
+                break;
+            }
+            IngestPipeline::print(metrics);
+            break;
+        }
+#ifndef _WIN32
+        case 27: {
+            SharedTariffTable* table = sharedTariffsForWriting();
+            if (!table) {
+                cout << "Не удалось открыть общую память.\n";
+                break;
+            }
+            vector<TariffRow> rows = atc.getTariffRows();
+            if (const TariffRow* row = SharedTariffTable::findTooLong(rows)) {
+                cout << "Таблица не опубликована: название направления " << row->destination << " длиннее "
+                    << SharedTariffTable::maxDestination - 1 << " байт.\n";
+                break;
+            }
+            uint64_t generation = table->publish(rows);
+            if (generation == 0) {
+                cout << "Таблица не опубликована: слишком много тарифов или запись занята другим процессом.\n";
+                break;
+            }
+            cout << "Тарифы опубликованы, версия таблицы: " << generation << "\n";
+            break;
+        }
+        case 28: {
+            if (atc.isUsingSharedTariffs()) {
+                atc.useSharedTariffs(nullptr);
+                cout << "Звонки тарифицируются по тарифам АТС " << atc.getName() << ".\n";
+                break;
+            }
+            const SharedTariffTable* table = sharedTariffsForReading();
+            if (!table) {
+                cout << "Общая таблица тарифов ещё не опубликована.\n";
+                break;
+            }
+            atc.useSharedTariffs(table);
+            cout << "Звонки тарифицируются по общей таблице тарифов.\n";
             break;
         }
+#endif
         case 0:
             OnDisplay = false;
             break;
@@ -210,8 +3736,66 @@ static void menu() {
     }
 }
 
-int main() {
-    setlocale(LC_ALL, "");
-    menu();
-    return 0;
+int main(int argc, char* argv[]) {
+    // Для кириллицы в консоли достаточно LC_CTYPE; LC_NUMERIC остаётся "C", и разбор чисел от локали не зависит
+    setlocale(LC_CTYPE, "");
+    if (argc == 1) {
+        menu();
+        return 0;
+    }
+
+    const string_view mode = argv[1];
+    if ((mode != "--script" && mode != "--replay") || argc < 3 || argc > (mode == "--replay" ? 4 : 3)) {
+        cerr << "Использование: " << argv[0] << " [--script <файл> | --script - | --replay <журнал> [потоков]]\n";
+        return 2;
+    }
+    string script;
+    if (!readScript(argv[2], script)) {
+        cerr << "Не удалось прочитать скрипт " << argv[2] << "\n";
+        return 2;
+    }
+
+    if (mode == "--replay") {
+        size_t threads = max(1u, thread::hardware_concurrency());
+        if (argc == 4 && (!parseNumber(argv[3], threads) || threads == 0)) {
+            cerr << "Некорректное число потоков: " << argv[3] << "\n";
+            return 2;
+        }
+        ATC atc("Основная");
+        auto start = chrono::steady_clock::now();
+        EventReplay::Result result = EventReplay::run(script, threads, atc);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        ReportWriter writer;
+        writer.text("Восстановлено событий: ").number(static_cast<unsigned long long>(result.events))
+            .text(", звонков: ").number(static_cast<unsigned long long>(atc.getCallsCount()))
+            .text(" за ").number(seconds, 3).text(" с");
+        if (seconds > 0) {
+            writer.text(" (").number(result.events / seconds, 0).text(" событий/с)");
+        }
+        writer.text(", потоков: ").number(static_cast<unsigned long long>(result.partitions)).text("\n");
+        writer.text("Общая выручка за все звонки: ").number(atc.getTotalRevenue(), moneyPrecision).text(" RUB\n");
+        uint64_t checksum = atc.getTotalsChecksum();
+        writer.text("Контрольная сумма итогов: ").number(static_cast<unsigned long long>(checksum)).text("\n");
+        bool matches = !result.hasChecksum || checksum == result.expectedChecksum;
+        if (!result.hasChecksum) {
+            writer.text("В конце журнала нет контрольной суммы, сверка не выполнялась.\n");
+        }
+        else {
+            writer.text(matches ? "Итоги совпадают с журналом.\n" : "Итоги НЕ совпадают с журналом!\n");
+        }
+        writer.flush(cout);
+        cout.flush();
+        return result.errors == 0 && matches ? 0 : 1;
+    }
+
+    ios::sync_with_stdio(false);
+    ATCRegistry registry;
+    CommandInterpreter interpreter(registry, "Основная");
+    auto start = chrono::steady_clock::now();
+    size_t errors = interpreter.run(script);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout.flush();
+    cerr << "Выполнено команд: " << interpreter.getExecutedCount() << " за " << seconds << " с, ошибок: " << errors << "\n";
+    return errors == 0 ? 0 : 1;
 }
@@ -3,24 +3,43 @@
 #include <limits>
 #include <string>
 #include <memory>
-#include <iomanip>
+#include <algorithm>
+#include <charconv>
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#include <array>
+#include <string_view>
+#include <fstream>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <iterator>
+#include <unordered_set>
+
+#include "Lab_PPP_common.h"
 
 using namespace std;
 
+// Стоимость тарифов выводится в целых единицах валюты
+constexpr int costPrecision = 0;
+
 class TariffStrategy {
 public:
     virtual ~TariffStrategy() = default;
     virtual double getCost() const = 0;
     virtual string getDestination() const = 0;
     virtual double getOriginalCost() const = 0;
+    virtual Currency getCurrency() const = 0;
 };
 
 class NoDiscountTariff : public TariffStrategy {
 private:
     string destination;
     double cost;
+    Currency currency;
 public:
-    NoDiscountTariff(const string& dest, double c) : destination(dest), cost(c) {}
+    NoDiscountTariff(const string& dest, double c, Currency cur = Currency::RUB) : destination(dest), cost(c), currency(cur) {}
 
     double getCost() const override {
         return cost;
@@ -33,6 +52,10 @@ public:
     double getOriginalCost() const override {
         return cost;
     }
+
+    Currency getCurrency() const override {
+        return currency;
+    }
 };
 
 class FixedDiscountTariff : public TariffStrategy {
@@ -40,9 +63,10 @@ private:
     string destination;
     double cost;
     double discount;
+    Currency currency;
 public:
-    FixedDiscountTariff(const string& dest, double c, double d)
-        : destination(dest), cost(c), discount(d) {}
+    FixedDiscountTariff(const string& dest, double c, double d, Currency cur = Currency::RUB)
+        : destination(dest), cost(c), discount(d), currency(cur) {}
 
     double getCost() const override {
         return cost - discount;
@@ -55,6 +79,10 @@ public:
     double getOriginalCost() const override {
         return cost;
     }
+
+    Currency getCurrency() const override {
+        return currency;
+    }
 };
 
 class PercentageDiscountTariff : public TariffStrategy {
@@ -62,9 +90,10 @@ private:
     string destination;
     double cost;
     double percentage;
+    Currency currency;
 public:
-    PercentageDiscountTariff(const string& dest, double c, double p)
-        : destination(dest), cost(c), percentage(p) {}
+    PercentageDiscountTariff(const string& dest, double c, double p, Currency cur = Currency::RUB)
+        : destination(dest), cost(c), percentage(p), currency(cur) {}
 
     double getCost() const override {
         return cost * (1 - percentage / 100);
@@ -77,34 +106,117 @@ public:
     double getOriginalCost() const override {
         return cost;
     }
+
+    Currency getCurrency() const override {
+        return currency;
+    }
+};
+
+enum class TariffSort {
+    ByDestination,
+    ByCost,
+    ByDiscount
 };
 
 class ATC {
 private:
     vector<shared_ptr<TariffStrategy>> tariffs;
+    vector<TariffRow> rows;
+
+    // Направления, для которых уже есть тариф; проверка на дубликат не перебирает все тарифы
+    unordered_set<string> destinations;
+
+    // Сумма стоимости тарифов по валютам; средняя стоимость пересчитывается по курсам только при запросе
+    CurrencyAmounts costSums = {};
+    ExchangeRates rates;
+
+    // Индекс сортировки; перестраивается только после добавления тарифа или смены порядка
+    mutable vector<size_t> sortIndex;
+    mutable TariffSort sortIndexOrder = TariffSort::ByDestination;
+    mutable bool sortIndexValid = false;
+
+    const vector<size_t>& getSortIndex(TariffSort order) const {
+        if (sortIndexValid && sortIndexOrder == order) {
+            return sortIndex;
+        }
+        sortIndex.resize(rows.size());
+        for (size_t i = 0; i < rows.size(); ++i) {
+            sortIndex[i] = i;
+        }
+        switch (order) {
+        case TariffSort::ByDestination:
+            stable_sort(sortIndex.begin(), sortIndex.end(), [this](size_t a, size_t b) {
+                return rows[a].destination < rows[b].destination;
+            });
+            break;
+        case TariffSort::ByCost:
+            stable_sort(sortIndex.begin(), sortIndex.end(), [this](size_t a, size_t b) {
+                return rows[a].cost * rates.getRate(rows[a].currency) < rows[b].cost * rates.getRate(rows[b].currency);
+            });
+            break;
+        case TariffSort::ByDiscount:
+            stable_sort(sortIndex.begin(), sortIndex.end(), [this](size_t a, size_t b) {
+                return (rows[a].originalCost - rows[a].cost) * rates.getRate(rows[a].currency)
+                    > (rows[b].originalCost - rows[b].cost) * rates.getRate(rows[b].currency);
+            });
+            break;
+        }
+        sortIndexOrder = order;
+        sortIndexValid = true;
+        return sortIndex;
+    }
+
+    static vector<ReportWriter::Column> tariffColumns() {
+        return {
+            { "destination", "Направление: ", "", 0 },
+            { "cost", " | Стоимость: ", "", costPrecision },
+            { "original_cost", " | Исходная стоимость: ", " ", costPrecision },
+            { "currency", "", "", 0 }
+        };
+    }
+
+    static void writeTariff(ReportWriter& writer, const TariffRow& row) {
+        writer.add(row.destination);
+        writer.add(row.cost);
+        writer.add(row.originalCost);
+        writer.add(currencyCode(row.currency));
+        writer.endRow();
+    }
+
 public:
     bool doesTariffExist(const string& destination) const {
-        for (const auto& tariff : tariffs) {
-            if (tariff->getDestination() == destination) {
-                return true;
-            }
-        }
-        return false;
+        return destinations.count(destination) != 0;
     }
 
     void addTariff(shared_ptr<TariffStrategy> tariff) {
+        rows.push_back({ tariff->getDestination(), tariff->getCost(), tariff->getOriginalCost(), tariff->getCurrency() });
+        costSums[static_cast<size_t>(tariff->getCurrency())] += rows.back().cost;
+        destinations.insert(rows.back().destination);
         tariffs.push_back(tariff);
+        sortIndexValid = false;
+    }
+
+    bool setExchangeRate(Currency currency, double rubles) {
+        if (!rates.setRate(currency, rubles)) {
+            return false;
+        }
+        sortIndexValid = false;
+        return true;
+    }
+
+    size_t getTariffsCount() const {
+        return tariffs.size();
     }
 
-    double calculateAverageCost() const {
+    const vector<TariffRow>& getRows() const {
+        return rows;
+    }
+
+    double calculateAverageCost(Currency target = Currency::RUB) const {
         if (tariffs.empty()) {
             return 0;
         }
-        double totalCost = 0;
-        for (const auto& tariff : tariffs) {
-            totalCost += tariff->getCost();
-        }
-        return totalCost / tariffs.size();
+        return rates.convert(costSums, target) / tariffs.size();
     }
 
     void printAllTariffs() const {
@@ -113,12 +225,63 @@ public:
             return;
         }
 
-        cout << "=== Список всех тарифов ===\n";
-        for (const auto& tariff : tariffs) {
-            cout << "Направление: " << tariff->getDestination()
-                << " | Стоимость: " << tariff->getCost()
-                << " | Исходная стоимость: " << tariff->getOriginalCost() << "\n";
+        ReportWriter writer(ReportFormat::Text, tariffColumns());
+        writer.text("=== Список всех тарифов ===\n");
+        for (const auto& row : rows) {
+            writeTariff(writer, row);
+        }
+        writer.flush(cout);
+    }
+
+    void exportTariffs(ostream& out, ReportFormat format) const {
+        ReportWriter writer(format, tariffColumns());
+        for (const auto& row : rows) {
+            writeTariff(writer, row);
         }
+        writer.flush(out);
+    }
+
+    // Вывод одной страницы отсортированного списка тарифов с поиском по направлению.
+    // cursor - позиция в индексе сортировки, с которой начинается страница;
+    // возвращает позицию для следующей страницы или количество тарифов, если список закончился.
+    size_t printTariffsPage(TariffSort order, const string& filter, bool prefixOnly, size_t cursor, size_t pageSize) const {
+        const vector<size_t>& index = getSortIndex(order);
+
+        // Для поиска по началу названия в списке, отсортированном по направлению, сразу переходим к первому совпадению
+        if (prefixOnly && order == TariffSort::ByDestination && cursor == 0 && !filter.empty()) {
+            cursor = lower_bound(index.begin(), index.end(), filter, [this](size_t i, const string& key) {
+                return rows[i].destination < key;
+            }) - index.begin();
+        }
+
+        ReportWriter writer(ReportFormat::Text, tariffColumns());
+        size_t printed = 0;
+        for (; cursor < index.size() && printed < pageSize; ++cursor) {
+            const TariffRow& row = rows[index[cursor]];
+            if (!filter.empty()) {
+                if (prefixOnly) {
+                    if (row.destination.compare(0, filter.size(), filter) != 0) {
+                        if (order == TariffSort::ByDestination) {
+                            cursor = index.size();
+                            break;
+                        }
+                        continue;
+                    }
+                }
+                else if (row.destination.find(filter) == string::npos) {
+                    continue;
+                }
+            }
+
+            writeTariff(writer, row);
+            ++printed;
+        }
+
+        if (printed == 0) {
+            writer.text("Подходящих тарифов нет.\n");
+        }
+        writer.flush(cout);
+        return cursor;
     }
 };
 
@@ -130,29 +293,221 @@ static void clearConsole() {
 #endif
 }
 
-static double inputNumber(const string& prompt) {
-    double value;
+// Ввод положительного числа отдельной строкой с повтором при ошибке; false - ввод закончился
+static bool inputNumber(const string& prompt, double& value) {
+    string line;
     while (true) {
         cout << prompt;
-        cin >> value;
-        if (cin.fail() || value <= 0) {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "Ошибка: введите положительное число.\n";
+        if (!getline(cin, line)) {
+            return false;
         }
-        else {
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            return value;
+        if (parseNumber(line, value) && value > 0) {
+            return true;
         }
+        cout << "Ошибка: введите положительное число.\n";
     }
 }
 
-int main() {
-    setlocale(LC_ALL, "Russian");
-    cout << fixed;
-    cout << setprecision(0);
+// Ввод кода валюты с повтором при ошибке; пустая строка означает рубли, false - ввод закончился
+static bool inputCurrency(const string& prompt, Currency& currency) {
+    string code;
+    while (true) {
+        cout << prompt;
+        if (!getline(cin, code)) {
+            return false;
+        }
+        currency = Currency::RUB;
+        if (trimSpaces(code).empty() || parseCurrency(trimSpaces(code), currency)) {
+            return true;
+        }
+        cout << "Ошибка: введите RUB, USD или EUR.\n";
+    }
+}
+
+// Команды пакетного режима (разбор строк - ScriptInterpreter в Lab_PPP_common.h):
+//
+//   tariff <направление> <стоимость> [валюта]             тариф без скидки
+//   fixed <направление> <стоимость> <скидка> [валюта]     тариф с фиксированной скидкой
+//   percent <направление> <стоимость> <процент> [валюта]  тариф с процентной скидкой
+//   exchange <валюта> <рублей>                            установить курс валюты
+//   list                                                  показать все тарифы
+//   average [валюта]                                      средняя стоимость тарифов
+//   export <text|csv|json> <файл>                         выгрузить тарифы в файл
+//   publish                                               опубликовать тарифы в общую память
+//   lookup <направление>                                  стоимость направления из общей памяти
+class CommandInterpreter : public ScriptInterpreter {
+public:
+    explicit CommandInterpreter(ATC& atc) : atc(atc) {
+    }
+
+private:
+    ATC& atc;
+
+    // Буфер для названия: после первых команд повторное присваивание не выделяет память
+    string destination;
+
+    const char* execute(const Command& command) override {
+        const string_view name = command.words[0];
+        const size_t count = command.count;
+        const char* badArguments = "неверное число аргументов";
+        const char* badValue = "некорректное значение аргумента";
+        Currency currency;
+
+        if (name == "tariff" || name == "fixed" || name == "percent") {
+            const bool discounted = name != "tariff";
+            const size_t currencyIndex = discounted ? 4 : 3;
+            double cost;
+            double discount = 0;
+            if (count < currencyIndex || count > currencyIndex + 1) {
+                return badArguments;
+            }
+            if (!parseNumber(command.words[2], cost) || cost <= 0
+                || (discounted && (!parseNumber(command.words[3], discount) || discount <= 0))
+                || !optionalCurrency(command, currencyIndex, currency)) {
+                return badValue;
+            }
+            destination.assign(command.words[1]);
+            if (atc.doesTariffExist(destination)) {
+                return "тариф на это направление уже существует";
+            }
+            if (name == "tariff") {
+                atc.addTariff(make_shared<NoDiscountTariff>(destination, cost, currency));
+            }
+            else if (name == "fixed") {
+                if (cost < discount) {
+                    return "стоимость не может быть ниже скидки";
+                }
+                atc.addTariff(make_shared<FixedDiscountTariff>(destination, cost, discount, currency));
+            }
+            else {
+                if (discount > 100) {
+                    return "процент скидки должен быть от 0 до 100";
+                }
+                atc.addTariff(make_shared<PercentageDiscountTariff>(destination, cost, discount, currency));
+            }
+            return nullptr;
+        }
+        if (name == "exchange") {
+            double rubles;
+            if (count != 3) {
+                return badArguments;
+            }
+            if (!parseCurrency(command.words[1], currency) || !parseNumber(command.words[2], rubles)
+                || !atc.setExchangeRate(currency, rubles)) {
+                return badValue;
+            }
+            return nullptr;
+        }
+        if (name == "list") {
+            if (count != 1) {
+                return badArguments;
+            }
+            atc.printAllTariffs();
+            return nullptr;
+        }
+        if (name == "average") {
+            if (count > 2) {
+                return badArguments;
+            }
+            if (!optionalCurrency(command, 1, currency)) {
+                return badValue;
+            }
+            ReportWriter writer;
+            writer.text("Средняя стоимость всех тарифов: ").number(atc.calculateAverageCost(currency), costPrecision)
+                .text(" ").text(currencyCode(currency)).text("\n");
+            writer.flush(cout);
+            return nullptr;
+        }
+        if (name == "export") {
+            if (count != 3) {
+                return badArguments;
+            }
+            string_view formatName = command.words[1];
+            if (formatName != "text" && formatName != "csv" && formatName != "json") {
+                return badValue;
+            }
+            ReportFormat format = formatName == "text" ? ReportFormat::Text
+                : formatName == "csv" ? ReportFormat::Csv : ReportFormat::Json;
+            ofstream file(string(command.words[2]), ios::binary);
+            if (!file) {
+                return "не удалось открыть файл";
+            }
+            atc.exportTariffs(file, format);
+            return nullptr;
+        }
+#ifndef _WIN32
+        if (name == "publish") {
+            if (count != 1) {
+                return badArguments;
+            }
+            SharedTariffTable* table = sharedTariffsForWriting();
+            if (!table) {
+                return "не удалось открыть общую память";
+            }
+            vector<TariffRow> rows = atc.getRows();
+            if (const TariffRow* row = SharedTariffTable::findTooLong(rows)) {
+                cout << "Направление не помещается в общую таблицу: " << row->destination << "\n";
+                return "таблица не опубликована: название направления длиннее 111 байт";
+            }
+            if (table->publish(rows) == 0) {
+                return "таблица не опубликована: слишком много тарифов или запись занята другим процессом";
+            }
+            return nullptr;
+        }
+        if (name == "lookup") {
+            if (count != 2) {
+                return badArguments;
+            }
+            const SharedTariffTable* table = sharedTariffsForReading();
+            if (!table) {
+                return "общая таблица тарифов ещё не опубликована";
+            }
+            double cost;
+            uint64_t generation;
+            destination.assign(command.words[1]);
+            SharedTariffTable::ReadStatus status = table->lookup(destination, cost, currency, generation);
+            if (status == SharedTariffTable::ReadStatus::Busy) {
+                return "общая таблица занята: запись в неё не завершилась";
+            }
+            if (status == SharedTariffTable::ReadStatus::NotFound) {
+                return "направление не найдено в общей таблице";
+            }
+            ReportWriter writer;
+            writer.text("Стоимость: ").number(cost, costPrecision).text(" ").text(currencyCode(currency))
+                .text(" (версия таблицы ").number(static_cast<unsigned long long>(generation)).text(")\n");
+            writer.flush(cout);
+            return nullptr;
+        }
+#endif
+        return "неизвестная команда";
+    }
+};
+
+
+int main(int argc, char* argv[]) {
+    // Для кириллицы в консоли достаточно LC_CTYPE; LC_NUMERIC остаётся "C", и разбор чисел от локали не зависит
+    setlocale(LC_CTYPE, "");
     ATC atc;
-    int choice;
+
+    if (argc > 1) {
+        if (argc != 3 || string_view(argv[1]) != "--script") {
+            cerr << "Использование: " << argv[0] << " [--script <файл> | --script -]\n";
+            return 2;
+        }
+        string script;
+        if (!readScript(argv[2], script)) {
+            cerr << "Не удалось прочитать скрипт " << argv[2] << "\n";
+            return 2;
+        }
+        ios::sync_with_stdio(false);
+        CommandInterpreter interpreter(atc);
+        auto start = chrono::steady_clock::now();
+        size_t errors = interpreter.run(script);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout.flush();
+        cerr << "Выполнено команд: " << interpreter.getExecutedCount() << " за " << seconds << " с, ошибок: " << errors << "\n";
+        return errors == 0 ? 0 : 1;
+    }
 
     while (true) {
         clearConsole();
@@ -162,13 +517,20 @@ int main() {
         cout << "3. Добавить новый тариф с процентной скидкой\n";
         cout << "4. Показать все тарифы\n";
         cout << "5. Показать среднюю стоимость тарифов\n";
+        cout << "6. Поиск и постраничный просмотр тарифов\n";
+        cout << "7. Опубликовать тарифы в общую память\n";
+        cout << "8. Узнать стоимость направления из общей памяти\n";
+        cout << "9. Загрузить тарифы из общей памяти\n";
+        cout << "10. Установить курс валюты\n";
+        cout << "11. Выгрузить тарифы в файл\n";
         cout << "0. Выход\n";
         cout << "Выберите действие: ";
-        cin >> choice;
-
-        if (cin.fail()) {
-            cin.clear();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        string line;
+        if (!getline(cin, line)) {
+            return 0;
+        }
+        int choice;
+        if (!parseNumber(line, choice)) {
             cout << "Ошибка: введите корректный номер действия.\n";
             continue;
         }
@@ -178,7 +540,6 @@ int main() {
             clearConsole();
             string destination;
             cout << "Введите название направления: ";
-            cin.ignore();
             getline(cin, destination);
 
             if (atc.doesTariffExist(destination)) {
@@ -186,8 +547,13 @@ int main() {
                 break;
             }
 
-            double cost = inputNumber("Введите стоимость: ");
-            atc.addTariff(make_shared<NoDiscountTariff>(destination, cost));
+            double cost;
+            Currency currency;
+            if (!inputNumber("Введите стоимость: ", cost)
+                || !inputCurrency("Введите валюту (RUB, USD, EUR; пусто - RUB): ", currency)) {
+                break;
+            }
+            atc.addTariff(make_shared<NoDiscountTariff>(destination, cost, currency));
             cout << "Тариф добавлен успешно.\n";
             break;
         }
@@ -195,7 +561,6 @@ int main() {
             clearConsole();
             string destination;
             cout << "Введите название направления: ";
-            cin.ignore();
             getline(cin, destination);
 
             if (atc.doesTariffExist(destination)) {
@@ -203,13 +568,19 @@ int main() {
                 break;
             }
 
-            double cost = inputNumber("Введите стоимость: ");
-            double discount = inputNumber("Введите размер скидки: ");
+            double cost, discount;
+            if (!inputNumber("Введите стоимость: ", cost) || !inputNumber("Введите размер скидки: ", discount)) {
+                break;
+            }
             if (cost < discount) {
                 cout << "Ошибка: стоимость не может быть ниже скидки.\n";
                 break;
             }
-            atc.addTariff(make_shared<FixedDiscountTariff>(destination, cost, discount));
+            Currency currency;
+            if (!inputCurrency("Введите валюту (RUB, USD, EUR; пусто - RUB): ", currency)) {
+                break;
+            }
+            atc.addTariff(make_shared<FixedDiscountTariff>(destination, cost, discount, currency));
             cout << "Тариф с фиксированной скидкой добавлен успешно.\n";
             break;
         }
@@ -217,7 +588,6 @@ int main() {
             clearConsole();
             string destination;
             cout << "Введите название направления: ";
-            cin.ignore();
             getline(cin, destination);
 
             if (atc.doesTariffExist(destination)) {
@@ -225,24 +595,190 @@ int main() {
                 break;
             }
 
-            double cost = inputNumber("Введите стоимость: ");
-            double percentage = inputNumber("Введите процент скидки: ");
+            double cost, percentage;
+            if (!inputNumber("Введите стоимость: ", cost) || !inputNumber("Введите процент скидки: ", percentage)) {
+                break;
+            }
             if (percentage < 0 || percentage > 100) {
                 cout << "Ошибка: процент скидки должен быть от 0 до 100.\n";
                 break;
             }
-            atc.addTariff(make_shared<PercentageDiscountTariff>(destination, cost, percentage));
+            Currency currency;
+            if (!inputCurrency("Введите валюту (RUB, USD, EUR; пусто - RUB): ", currency)) {
+                break;
+            }
+            atc.addTariff(make_shared<PercentageDiscountTariff>(destination, cost, percentage, currency));
             cout << "Тариф с процентной скидкой добавлен успешно.\n";
             break;
         }
         case 4:
             atc.printAllTariffs();
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
             break;
         case 5: {
-            double avgCost = atc.calculateAverageCost();
-            cout << "Средняя стоимость всех тарифов: " << avgCost << "\n";
-            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            Currency currency;
+            if (!inputCurrency("Валюта отчёта (RUB, USD, EUR; пусто - RUB): ", currency)) {
+                break;
+            }
+            ReportWriter writer;
+            writer.text("Средняя стоимость всех тарифов: ").number(atc.calculateAverageCost(currency), costPrecision)
+                .text(" ").text(currencyCode(currency)).text("\n");
+            writer.flush(cout);
+            break;
+        }
+        case 6: {
+            clearConsole();
+            string answer;
+            int sortChoice;
+            cout << "Сортировать по (1 - направлению, 2 - стоимости, 3 - размеру скидки): ";
+            if (!getline(cin, answer) || !parseNumber(answer, sortChoice) || sortChoice < 1 || sortChoice > 3) {
+                cout << "Ошибка: неверный выбор сортировки.\n";
+                break;
+            }
+            TariffSort order = sortChoice == 1 ? TariffSort::ByDestination
+                : sortChoice == 2 ? TariffSort::ByCost : TariffSort::ByDiscount;
+
+            string filter;
+            cout << "Введите строку поиска (пусто - все тарифы): ";
+            getline(cin, filter);
+            bool prefixOnly = false;
+            if (!filter.empty()) {
+                string answer;
+                cout << "Искать только по началу названия? (д/н): ";
+                getline(cin, answer);
+                prefixOnly = answer == "д" || answer == "Д" || answer == "y";
+            }
+
+            const size_t pageSize = 20;
+            size_t cursor = 0;
+            while (true) {
+                cursor = atc.printTariffsPage(order, filter, prefixOnly, cursor, pageSize);
+                if (cursor >= atc.getTariffsCount()) {
+                    break;
+                }
+                string answer;
+                cout << "Enter - следующая страница, q - выход: ";
+                getline(cin, answer);
+                if (answer == "q") {
+                    break;
+                }
+            }
+            break;
+        }
+        case 10: {
+            Currency currency;
+            double rubles;
+            if (!inputCurrency("Введите валюту (USD, EUR): ", currency)
+                || !inputNumber("Введите стоимость единицы валюты в рублях: ", rubles)) {
+                break;
+            }
+            if (!atc.setExchangeRate(currency, rubles)) {
+                cout << "Ошибка: курс можно задать только для USD и EUR.\n";
+                break;
+            }
+            cout << "Курс " << currencyCode(currency) << " установлен.\n";
+            break;
+        }
+#ifndef _WIN32
+        case 7: {
+            SharedTariffTable* table = sharedTariffsForWriting();
+            if (!table) {
+                cout << "Ошибка: не удалось открыть общую память.\n";
+                break;
+            }
+            vector<TariffRow> rows = atc.getRows();
+            if (const TariffRow* row = SharedTariffTable::findTooLong(rows)) {
+                cout << "Ошибка: название направления " << row->destination << " длиннее "
+                    << SharedTariffTable::maxDestination - 1 << " байт.\n";
+                break;
+            }
+            uint64_t generation = table->publish(rows);
+            if (generation == 0) {
+                cout << "Ошибка: слишком много тарифов или запись занята другим процессом.\n";
+            }
+            else {
+                cout << "Тарифы опубликованы, версия таблицы: " << generation << "\n";
+            }
+            break;
+        }
+        case 8: {
+            clearConsole();
+            string destination;
+            cout << "Введите название направления: ";
+            getline(cin, destination);
+
+            const SharedTariffTable* table = sharedTariffsForReading();
+            if (!table) {
+                cout << "Ошибка: общая таблица тарифов ещё не опубликована.\n";
+                break;
+            }
+            double cost;
+            Currency currency;
+            uint64_t generation;
+            SharedTariffTable::ReadStatus status = table->lookup(destination, cost, currency, generation);
+            if (status == SharedTariffTable::ReadStatus::Busy) {
+                cout << "Ошибка: общая таблица занята, запись в неё не завершилась.\n";
+            }
+            else if (status == SharedTariffTable::ReadStatus::Found) {
+                ReportWriter writer;
+                writer.text("Стоимость: ").number(cost, costPrecision).text(" ").text(currencyCode(currency))
+                    .text(" (версия таблицы ").number(static_cast<unsigned long long>(generation)).text(")\n");
+                writer.flush(cout);
+            }
+            else {
+                cout << "Ошибка: направление не найдено в общей таблице.\n";
+            }
+            break;
+        }
+        case 9: {
+            const SharedTariffTable* table = sharedTariffsForReading();
+            if (!table) {
+                cout << "Ошибка: общая таблица тарифов ещё не опубликована.\n";
+                break;
+            }
+            vector<TariffRow> rows;
+            uint64_t generation;
+            if (table->snapshot(rows, generation) == SharedTariffTable::ReadStatus::Busy) {
+                cout << "Ошибка: общая таблица занята, запись в неё не завершилась.\n";
+                break;
+            }
+            size_t added = 0;
+            for (const auto& row : rows) {
+                if (atc.doesTariffExist(row.destination)) {
+                    continue;
+                }
+                if (row.cost < row.originalCost) {
+                    atc.addTariff(make_shared<FixedDiscountTariff>(row.destination, row.originalCost, row.originalCost - row.cost, row.currency));
+                }
+                else {
+                    atc.addTariff(make_shared<NoDiscountTariff>(row.destination, row.cost, row.currency));
+                }
+                ++added;
+            }
+            cout << "Загружено тарифов: " << added << " (версия таблицы " << generation << ")\n";
+            break;
+        }
+#endif
+        case 11: {
+            string answer;
+            int formatChoice;
+            cout << "Формат (1 - текст, 2 - CSV, 3 - JSON): ";
+            if (!getline(cin, answer) || !parseNumber(answer, formatChoice) || formatChoice < 1 || formatChoice > 3) {
+                cout << "Ошибка: неверный формат.\n";
+                break;
+            }
+            ReportFormat format = formatChoice == 1 ? ReportFormat::Text
+                : formatChoice == 2 ? ReportFormat::Csv : ReportFormat::Json;
+
+            string fileName;
+            cout << "Введите имя файла: ";
+            getline(cin, fileName);
+            ofstream file(fileName, ios::binary);
+            if (!file) {
+                cout << "Ошибка: не удалось открыть файл " << fileName << "\n";
+                break;
+            }
+            atc.exportTariffs(file, format);
+            cout << "Тарифы выгружены в " << fileName << "\n";
             break;
         }
         case 0:
@@ -0,0 +1,752 @@
+// Общая часть Lab_PPP_2 и Lab_PPP_3: валюты и курсы, буферизованный вывод отчётов, разбор чисел
+// и пакетный режим. Каждая программа собирается из одного файла .cpp, поэтому заголовок попадает
+// в единственную единицу трансляции и отдельной сборки не требует.
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <array>
+#include <fstream>
+#include <iterator>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <type_traits>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+#endif
+
+using namespace std;
+
+enum class Currency {
+    RUB,
+    USD,
+    EUR
+};
+
+constexpr size_t currencyCount = 3;
+
+// Суммы, разложенные по валютам; пересчёт выполняется только при построении отчёта
+using CurrencyAmounts = array<double, currencyCount>;
+
+inline const char* currencyCode(Currency currency) {
+    static const char* codes[currencyCount] = { "RUB", "USD", "EUR" };
+    return codes[static_cast<size_t>(currency)];
+}
+
+inline bool parseCurrency(string_view code, Currency& currency) {
+    for (size_t i = 0; i < currencyCount; ++i) {
+        if (code == currencyCode(static_cast<Currency>(i))) {
+            currency = static_cast<Currency>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Курсы валют относительно рубля. Итоги по каждой валюте копятся отдельно,
+// поэтому пересчёт итога в любую валюту стоит одно умножение на валюту, а не на звонок.
+class ExchangeRates {
+private:
+    array<double, currencyCount> rubPerUnit = { 1.0, 90.0, 100.0 };
+
+public:
+    double getRate(Currency currency) const {
+        return rubPerUnit[static_cast<size_t>(currency)];
+    }
+
+    bool setRate(Currency currency, double rubles) {
+        if (currency == Currency::RUB || rubles <= 0) {
+            return false;
+        }
+        rubPerUnit[static_cast<size_t>(currency)] = rubles;
+        return true;
+    }
+
+    double convert(double amount, Currency from, Currency to) const {
+        return amount * getRate(from) / getRate(to);
+    }
+
+    double convert(const CurrencyAmounts& amounts, Currency to) const {
+        double total = 0;
+        for (size_t i = 0; i < currencyCount; ++i) {
+            total += amounts[i] * rubPerUnit[i];
+        }
+        return total / getRate(to);
+    }
+};
+
+enum class ReportFormat {
+    Text,
+    Csv,
+    Json
+};
+
+// Буферизованный вывод отчётов. Числа форматируются через to_chars (в тексте - с точностью столбца),
+// строки копятся в одном буфере и выводятся одной записью. В текстовом формате у столбца есть
+// текст до и после значения, в CSV - заголовок из ключей столбцов, в JSON - массив объектов.
+class ReportWriter {
+public:
+    // precision < 0 - формат как у потока по умолчанию (6 значащих цифр)
+    struct Column {
+        const char* key;
+        const char* prefix;
+        const char* suffix;
+        int precision;
+    };
+
+private:
+    ReportFormat format;
+    vector<Column> columns;
+    string buffer;
+    size_t field = 0;
+    size_t rows = 0;
+    bool started = false;
+
+    void appendDouble(double value, int precision) {
+        char number[64];
+        auto result = precision < 0
+            ? to_chars(number, number + sizeof(number), value, chars_format::general, 6)
+            : to_chars(number, number + sizeof(number), value, chars_format::fixed, precision);
+        buffer.append(number, result.ptr);
+    }
+
+    void appendJsonString(string_view value) {
+        buffer += '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                buffer += '\\';
+                buffer += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                buffer += escaped;
+            }
+            else {
+                buffer += c;
+            }
+        }
+        buffer += '"';
+    }
+
+    void appendCsvString(string_view value) {
+        if (value.find_first_of(",\"\n") == string_view::npos) {
+            buffer.append(value);
+            return;
+        }
+        buffer += '"';
+        for (char c : value) {
+            if (c == '"') {
+                buffer += '"';
+            }
+            buffer += c;
+        }
+        buffer += '"';
+    }
+
+    void start() {
+        if (started) {
+            return;
+        }
+        started = true;
+        if (format == ReportFormat::Csv) {
+            for (size_t i = 0; i < columns.size(); ++i) {
+                buffer += i ? "," : "";
+                buffer += columns[i].key;
+            }
+            buffer += '\n';
+        }
+        else if (format == ReportFormat::Json) {
+            buffer += "[";
+        }
+    }
+
+    // Разделители перед значением очередного столбца
+    void beginField() {
+        start();
+        if (field >= columns.size()) {
+            return;
+        }
+        const Column& column = columns[field];
+        switch (format) {
+        case ReportFormat::Text:
+            buffer += column.prefix;
+            break;
+        case ReportFormat::Csv:
+            if (field > 0) {
+                buffer += ',';
+            }
+            break;
+        case ReportFormat::Json:
+            buffer += field == 0 ? (rows == 0 ? "\n{" : ",\n{") : ",";
+            appendJsonString(column.key);
+            buffer += ':';
+            break;
+        }
+    }
+
+    void endField() {
+        if (field < columns.size() && format == ReportFormat::Text) {
+            buffer += columns[field].suffix;
+        }
+        ++field;
+    }
+
+public:
+    explicit ReportWriter(ReportFormat reportFormat = ReportFormat::Text, vector<Column> reportColumns = {})
+        : format(reportFormat), columns(move(reportColumns)) {}
+
+    // Произвольный текст вне таблицы (только для текстового формата)
+    ReportWriter& text(string_view value) {
+        if (format == ReportFormat::Text) {
+            buffer.append(value);
+        }
+        return *this;
+    }
+
+    ReportWriter& number(double value, int precision = -1) {
+        if (format == ReportFormat::Text) {
+            appendDouble(value, precision);
+        }
+        return *this;
+    }
+
+    ReportWriter& number(unsigned long long value) {
+        if (format == ReportFormat::Text) {
+            char number[24];
+            buffer.append(number, to_chars(number, number + sizeof(number), value).ptr);
+        }
+        return *this;
+    }
+
+    void add(string_view value) {
+        beginField();
+        if (format == ReportFormat::Json) {
+            appendJsonString(value);
+        }
+        else if (format == ReportFormat::Csv) {
+            appendCsvString(value);
+        }
+        else {
+            buffer.append(value);
+        }
+        endField();
+    }
+
+    // Точность столбца - только для текста; в CSV и JSON число пишется кратчайшей записью,
+    // из которой читается то же значение
+    void add(double value) {
+        beginField();
+        if (format == ReportFormat::Text) {
+            appendDouble(value, field < columns.size() ? columns[field].precision : -1);
+        }
+        else {
+            char number[32];
+            buffer.append(number, to_chars(number, number + sizeof(number), value).ptr);
+        }
+        endField();
+    }
+
+    void add(unsigned long long value) {
+        beginField();
+        char number[24];
+        buffer.append(number, to_chars(number, number + sizeof(number), value).ptr);
+        endField();
+    }
+
+    void endRow() {
+        if (format == ReportFormat::Json) {
+            buffer += '}';
+        }
+        else {
+            buffer += '\n';
+        }
+        field = 0;
+        ++rows;
+    }
+
+    size_t getRows() const {
+        return rows;
+    }
+
+    // Сброс накопленного буфера, если он вырос больше limit (для выгрузки больших отчётов в файл)
+    void flushIfLarger(ostream& out, size_t limit) {
+        if (buffer.size() > limit) {
+            out.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+
+    // Завершение отчёта и вывод одной записью
+    void flush(ostream& out) {
+        if (format == ReportFormat::Json && started) {
+            buffer += rows ? "\n]\n" : "]\n";
+            started = false;
+        }
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+};
+
+inline string_view trimSpaces(string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+// Разбор числа через from_chars: результат не зависит от локали, а строка должна быть числом целиком
+template <typename T>
+inline bool parseNumber(string_view text, T& value) {
+    text = trimSpaces(text);
+    if (!text.empty() && text.front() == '+') {
+        text.remove_prefix(1);
+    }
+    const char* end = text.data() + text.size();
+    auto result = from_chars(text.data(), end, value);
+    if (result.ec != errc() || result.ptr != end || text.empty()) {
+        return false;
+    }
+    if constexpr (is_floating_point_v<T>) {
+        return isfinite(value);
+    }
+    return true;
+}
+
+// Читает скрипт целиком; "-" означает стандартный ввод
+inline bool readScript(const char* path, string& script) {
+    if (string_view(path) == "-") {
+        script.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+        return !cin.bad();
+    }
+    ifstream file(path, ios::binary);
+    if (!file) {
+        return false;
+    }
+    file.seekg(0, ios::end);
+    script.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0, ios::beg);
+    file.read(script.data(), static_cast<streamsize>(script.size()));
+    return static_cast<bool>(file);
+}
+
+// Пакетный режим: одна команда на строку, слова разделяются пробелами, имена с пробелами
+// берутся в кавычки, всё после # - комментарий. Скрипт читается в память целиком, слова команды -
+// string_view на этот буфер, поэтому разбор строки не выделяет память и не зависит от локали.
+// Набор команд задаёт программа в наследнике через execute.
+class ScriptInterpreter {
+public:
+    static constexpr size_t maxWords = 8;
+
+    struct Command {
+        array<string_view, maxWords> words;
+        size_t count = 0;
+    };
+
+    // Разбивает строку на слова; false - незакрытая кавычка, кавычка внутри слова или слишком много слов
+    static bool tokenize(string_view line, Command& command) {
+        command.count = 0;
+        size_t pos = 0;
+        while (true) {
+            while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t' || line[pos] == '\r')) {
+                ++pos;
+            }
+            if (pos == line.size() || line[pos] == '#') {
+                return true;
+            }
+            if (command.count == maxWords) {
+                return false;
+            }
+            size_t end;
+            if (line[pos] == '"') {
+                end = line.find('"', pos + 1);
+                if (end == string_view::npos) {
+                    return false;
+                }
+                command.words[command.count++] = line.substr(pos + 1, end - pos - 1);
+                ++end;
+                if (end < line.size() && line[end] != ' ' && line[end] != '\t' && line[end] != '\r') {
+                    return false;
+                }
+            }
+            else {
+                // Кавычка внутри слова не допускается: имена пишутся в журнал событий в кавычках
+                // без экранирования, и такое слово нельзя было бы прочитать обратно
+                end = pos;
+                while (end < line.size() && line[end] != ' ' && line[end] != '\t' && line[end] != '\r') {
+                    if (line[end] == '"') {
+                        return false;
+                    }
+                    ++end;
+                }
+                command.words[command.count++] = line.substr(pos, end - pos);
+            }
+            pos = end;
+        }
+    }
+
+    virtual ~ScriptInterpreter() = default;
+
+    size_t getExecutedCount() const {
+        return executed;
+    }
+
+    // Выполняет все команды скрипта; ошибки выводятся с номером строки, выполнение продолжается.
+    // Возвращает число строк с ошибками.
+    size_t run(string_view script) {
+        prepare(script);
+        size_t errors = 0;
+        size_t lineNumber = 0;
+        while (!script.empty()) {
+            size_t end = script.find('\n');
+            string_view line = script.substr(0, end);
+            script.remove_prefix(end == string_view::npos ? script.size() : end + 1);
+            ++lineNumber;
+
+            if (const char* error = executeLine(line)) {
+                ++errors;
+                cerr << "Строка " << lineNumber << ": " << error << "\n";
+            }
+        }
+        return errors;
+    }
+
+    // Выполняет одну строку скрипта; возвращает текст ошибки или nullptr
+    const char* executeLine(string_view line) {
+        Command command;
+        if (!tokenize(line, command)) {
+            return "ошибка синтаксиса";
+        }
+        if (command.count == 0) {
+            return nullptr;
+        }
+        ++executed;
+        return execute(command);
+    }
+
+protected:
+    // Вызывается перед выполнением скрипта целиком, например чтобы заранее выделить память
+    virtual void prepare(string_view) {
+    }
+
+    // Возвращает текст ошибки или nullptr
+    virtual const char* execute(const Command& command) = 0;
+
+    static bool optionalCurrency(const Command& command, size_t index, Currency& currency) {
+        currency = Currency::RUB;
+        return index >= command.count || parseCurrency(command.words[index], currency);
+    }
+
+private:
+    size_t executed = 0;
+};
+
+// Плоская копия полей тарифа: для сортировки и вывода без виртуальных вызовов (Lab_PPP_3)
+// и для обмена таблицей тарифов между процессами
+struct TariffRow {
+    string destination;
+    double cost;
+    double originalCost;
+    Currency currency;
+};
+
+#ifndef _WIN32
+// Таблица тарифов в общей памяти POSIX для нескольких процессов-тарификаторов.
+// Внутри области нет указателей, только смещения, поэтому каждый процесс может отобразить её по любому адресу.
+// Запись защищена seqlock: писатель захватывает запись, переводя счётчик из чётного в нечётный, читатели
+// повторяют чтение, если счётчик был нечётным или изменился. Каждая публикация увеличивает номер версии.
+// Ожидание нечётного счётчика ограничено lockTimeout, чтобы упавший посреди записи писатель не подвешивал
+// остальных: читатель сообщает, что таблица занята, а следующий писатель перехватывает запись.
+class SharedTariffTable {
+public:
+    static constexpr size_t maxTariffs = 65536;
+    static constexpr size_t maxDestination = 112;
+    static constexpr chrono::milliseconds lockTimeout{ 1000 };
+
+    enum class ReadStatus {
+        Found,
+        NotFound,
+        Busy
+    };
+
+private:
+    struct Entry {
+        char destination[maxDestination];
+        double cost;
+        double originalCost;
+        uint32_t currency;
+    };
+
+    struct Header {
+        atomic<uint64_t> sequence;
+        uint64_t generation;
+        uint64_t count;
+        uint64_t entriesOffset;
+        uint64_t indexOffset;
+        // Процесс, захвативший запись; его таблица перехватывается, только если процесса уже нет
+        atomic<int32_t> owner;
+    };
+
+    static_assert(atomic<uint64_t>::is_always_lock_free, "seqlock requires a lock-free 64-bit counter");
+    static_assert(atomic<int32_t>::is_always_lock_free, "owner must be readable from another process");
+
+    static constexpr size_t entriesOffset = 64;
+    static constexpr size_t indexOffset = entriesOffset + maxTariffs * sizeof(Entry);
+    static constexpr size_t regionSize = indexOffset + maxTariffs * sizeof(uint32_t);
+
+    void* region = nullptr;
+    bool writable = false;
+
+    Header* header() const {
+        return static_cast<Header*>(region);
+    }
+
+    const Entry* entries() const {
+        return reinterpret_cast<const Entry*>(static_cast<const char*>(region) + header()->entriesOffset);
+    }
+
+    const uint32_t* index() const {
+        return reinterpret_cast<const uint32_t*>(static_cast<const char*>(region) + header()->indexOffset);
+    }
+
+    static Currency toCurrency(uint32_t code) {
+        return code < currencyCount ? static_cast<Currency>(code) : Currency::RUB;
+    }
+
+    // Ждёт чётного счётчика: сначала короткий цикл, затем с уступкой процессора.
+    // false - счётчик остаётся нечётным дольше lockTimeout; в sequence последнее прочитанное значение.
+    bool waitEven(uint64_t& sequence) const {
+        chrono::steady_clock::time_point deadline;
+        for (unsigned attempt = 0;; ++attempt) {
+            sequence = header()->sequence.load(memory_order_acquire);
+            if ((sequence & 1) == 0) {
+                return true;
+            }
+            if (attempt < 64) {
+                continue;
+            }
+            if (attempt == 64) {
+                deadline = chrono::steady_clock::now() + lockTimeout;
+            }
+            else if (chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            this_thread::yield();
+        }
+    }
+
+    // Писатель, державший нечётный счётчик, завершился, не освободив его
+    static bool ownerIsGone(int32_t pid) {
+        return pid <= 0 || (kill(pid, 0) == -1 && errno == ESRCH);
+    }
+
+    SharedTariffTable(void* mapped, bool canWrite) : region(mapped), writable(canWrite) {}
+
+public:
+    SharedTariffTable(const SharedTariffTable&) = delete;
+    SharedTariffTable& operator=(const SharedTariffTable&) = delete;
+
+    ~SharedTariffTable() {
+        if (region) {
+            munmap(region, regionSize);
+        }
+    }
+
+    // Создание (или открытие существующей) области для публикации
+    static unique_ptr<SharedTariffTable> openForWriting(const string& regionName) {
+        int fd = shm_open(regionName.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0) {
+            return nullptr;
+        }
+        if (ftruncate(fd, regionSize) != 0) {
+            close(fd);
+            return nullptr;
+        }
+        void* mapped = mmap(nullptr, regionSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            return nullptr;
+        }
+        return unique_ptr<SharedTariffTable>(new SharedTariffTable(mapped, true));
+    }
+
+    // Подключение читателя: область отображается только для чтения
+    static unique_ptr<SharedTariffTable> openForReading(const string& regionName) {
+        int fd = shm_open(regionName.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            return nullptr;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < regionSize) {
+            close(fd);
+            return nullptr;
+        }
+        void* mapped = mmap(nullptr, regionSize, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            return nullptr;
+        }
+        return unique_ptr<SharedTariffTable>(new SharedTariffTable(mapped, false));
+    }
+
+    // Первая строка, направление которой не помещается в запись таблицы (с завершающим нулём);
+    // обрезать название нельзя - обрезанное направление не найдётся, а UTF-8 может разрезаться посреди буквы
+    static const TariffRow* findTooLong(const vector<TariffRow>& rows) {
+        for (const auto& row : rows) {
+            if (row.destination.size() >= maxDestination) {
+                return &row;
+            }
+        }
+        return nullptr;
+    }
+
+    // Атомарная с точки зрения читателей замена всей таблицы. Возвращает номер новой версии
+    // или 0, если тарифов больше maxTariffs, название направления не помещается (findTooLong), запись дольше lockTimeout держит живой процесс
+    // или её перехватил другой писатель.
+    uint64_t publish(const vector<TariffRow>& rows) {
+        if (!writable || rows.size() > maxTariffs || findTooLong(rows)) {
+            return 0;
+        }
+        Header* h = header();
+        Entry* target = reinterpret_cast<Entry*>(static_cast<char*>(region) + entriesOffset);
+        uint32_t* targetIndex = reinterpret_cast<uint32_t*>(static_cast<char*>(region) + indexOffset);
+
+        // Захват записи: чётный счётчик становится нечётным. Таблица переписывается целиком,
+        // поэтому после упавшего писателя запись перехватывается сдвигом нечётного счётчика на 2.
+        // Живого, но зависшего писателя не перехватываем: он продолжил бы писать поверх новой таблицы.
+        uint64_t sequence;
+        while (true) {
+            uint64_t step = 1;
+            if (!waitEven(sequence)) {
+                if (!ownerIsGone(h->owner.load(memory_order_relaxed))) {
+                    return 0;
+                }
+                step = 2;
+            }
+            if (h->sequence.compare_exchange_weak(sequence, sequence + step, memory_order_acquire, memory_order_relaxed)) {
+                sequence += step;
+                break;
+            }
+        }
+        h->owner.store(static_cast<int32_t>(getpid()), memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+
+        for (size_t i = 0; i < rows.size(); ++i) {
+            memset(target[i].destination, 0, maxDestination);
+            memcpy(target[i].destination, rows[i].destination.data(), rows[i].destination.size());
+            target[i].cost = rows[i].cost;
+            target[i].originalCost = rows[i].originalCost;
+            target[i].currency = static_cast<uint32_t>(rows[i].currency);
+            targetIndex[i] = static_cast<uint32_t>(i);
+        }
+        sort(targetIndex, targetIndex + rows.size(), [target](uint32_t a, uint32_t b) {
+            return strcmp(target[a].destination, target[b].destination) < 0;
+        });
+        h->count = rows.size();
+        h->entriesOffset = entriesOffset;
+        h->indexOffset = indexOffset;
+        uint64_t generation = ++h->generation;
+
+        // Если запись всё же перехватили (процесс счёлся завершённым), счётчик уже другой:
+        // освобождать его нельзя, таблицу допишет перехвативший писатель
+        if (!h->sequence.compare_exchange_strong(sequence, sequence + 1, memory_order_release, memory_order_relaxed)) {
+            return 0;
+        }
+        return generation;
+    }
+
+    // Согласованная копия всей таблицы; Busy - запись не завершилась за lockTimeout
+    ReadStatus snapshot(vector<TariffRow>& rows, uint64_t& generation) const {
+        while (true) {
+            uint64_t before;
+            if (!waitEven(before)) {
+                return ReadStatus::Busy;
+            }
+            generation = header()->generation;
+            size_t count = min<uint64_t>(header()->count, maxTariffs);
+            rows.clear();
+            if (generation != 0) {
+                const Entry* source = entries();
+                for (size_t i = 0; i < count; ++i) {
+                    rows.push_back({ string(source[i].destination, strnlen(source[i].destination, maxDestination)),
+                        source[i].cost, source[i].originalCost, toCurrency(source[i].currency) });
+                }
+            }
+            atomic_thread_fence(memory_order_acquire);
+            if (header()->sequence.load(memory_order_relaxed) == before) {
+                return ReadStatus::Found;
+            }
+        }
+    }
+
+    // Поиск стоимости направления двоичным поиском по индексу без копирования таблицы
+    ReadStatus lookup(const string& destination, double& cost, Currency& currency, uint64_t& generation) const {
+        while (true) {
+            uint64_t before;
+            if (!waitEven(before)) {
+                return ReadStatus::Busy;
+            }
+            generation = header()->generation;
+            bool found = false;
+            if (generation != 0) {
+                const Entry* source = entries();
+                const uint32_t* sorted = index();
+                size_t count = min<uint64_t>(header()->count, maxTariffs);
+                const uint32_t* it = lower_bound(sorted, sorted + count, destination, [source](uint32_t i, const string& key) {
+                    return strncmp(source[i].destination, key.c_str(), maxDestination) < 0;
+                });
+                if (it != sorted + count && *it < maxTariffs
+                    && strncmp(source[*it].destination, destination.c_str(), maxDestination) == 0) {
+                    cost = source[*it].cost;
+                    currency = toCurrency(source[*it].currency);
+                    found = true;
+                }
+            }
+            atomic_thread_fence(memory_order_acquire);
+            if (header()->sequence.load(memory_order_relaxed) == before) {
+                return found ? ReadStatus::Found : ReadStatus::NotFound;
+            }
+        }
+    }
+};
+
+constexpr const char* sharedTariffsName = "/atc_tariffs";
+
+// Общая таблица отображается один раз на процесс и остаётся отображённой до его завершения
+// (область не удаляется и не меняет размер). Пока таблица не опубликована, чтение возвращает
+// nullptr, и следующий вызов пробует подключиться снова.
+inline const SharedTariffTable* sharedTariffsForReading() {
+    static unique_ptr<SharedTariffTable> table;
+    if (!table) {
+        table = SharedTariffTable::openForReading(sharedTariffsName);
+    }
+    return table.get();
+}
+
+inline SharedTariffTable* sharedTariffsForWriting() {
+    static unique_ptr<SharedTariffTable> table;
+    if (!table) {
+        table = SharedTariffTable::openForWriting(sharedTariffsName);
+    }
+    return table.get();
+}
+#endif